@@ -0,0 +1,407 @@
+/**
+ * @file autotune.c
+ * @brief Run short trials on this machine and write a tuning profile
+ *   (tune.txt) for find-key and rho-batch: Montgomery kernel, rho_batch
+ *   step kernel, gcd length and worker count, pollardRho thread count,
+ *   the cost model constants and the key sizes from which one key is
+ *   faster on rho_batch than on pollardRho, and on cfrac than on either.
+ *   Finishes with predicted against measured time-to-factor for every
+ *   key size class, on fresh keys.
+ *
+ *   Usage: autotune [-o profile] [-m max_bits] [-s seed]
+ * @version 0.1
+ * @date 2021-05-28
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "rsa.h"
+#include "primefact.h"
+#include "codebook.h"
+#include "rhobatch.h"
+#include "montlane.h"
+#include "rho52.h"
+#include "cfrac.h"
+#include "tune.h"
+
+#define MAX_CLASSES 16
+#define CLASS_KEYS 8     // keys timed per size class
+#define CORPUS_BITS 64   // size of the rho_batch trial corpus
+#define CORPUS_KEYS 64
+#define CODEBOOK_BITS 32 // largest size with 2 byte blocks
+#define CODEBOOK_USEC 100000 // repeat the codebook trial this long
+
+struct timespec timer_start()
+{
+	struct timespec tick;
+	clock_gettime(CLOCK_MONOTONIC, &tick);
+	return tick;
+}
+
+uint64_t timer_end(struct timespec tick)
+{
+	struct timespec tock;
+	clock_gettime(CLOCK_MONOTONIC, &tock);
+	uint64_t start_nanos = tick.tv_sec * (long)1e9 + tick.tv_nsec;
+	uint64_t end_nanos = tock.tv_sec * (long)1e9 + tock.tv_nsec;
+
+	return (end_nanos - start_nanos) / 1000;
+}
+
+typedef struct {
+	int bits;
+	rsa_keys_t keys[CLASS_KEYS];
+} key_class_t;
+
+void make_keys(rsa_keys_t *keys, int count, int bits, unsigned long seed)
+{
+	gmp_randstate_t state;
+	gmp_randinit_mt(state);
+	gmp_randseed_ui(state, seed * 1000 + bits);
+	for (int i = 0; i < count; i++) {
+		rsa_genkeys_state(bits, &keys[i], state);
+	}
+	gmp_randclear(state);
+}
+
+void free_keys(rsa_keys_t *keys, int count)
+{
+	for (int i = 0; i < count; i++) {
+		mpz_clears(keys[i].p, keys[i].q, keys[i].n, keys[i].d, keys[i].e, NULL);
+	}
+}
+
+void *race_thread(void *input)
+{
+	rsa_decrypt_t *thread_struct = (rsa_decrypt_t *)input;
+	pollardRho(thread_struct->keys->n, thread_struct);
+	return NULL;
+}
+
+/**
+ * @brief Factor one key the way find-key does, pollardRho threads racing
+ *   on different walks.
+ */
+uint64_t time_race(rsa_keys_t *keys, int threads)
+{
+	pthread_t thread_ids[TUNE_MAX_THREADS];
+	rsa_decrypt_t racers[TUNE_MAX_THREADS];
+	int found = 0;
+
+	struct timespec t = timer_start();
+	for (int i = 0; i < threads; i++) {
+		racers[i].keys = keys;
+		racers[i].found = &found;
+		racers[i].seed = i;
+		mpz_init(racers[i].p);
+		pthread_create(&thread_ids[i], NULL, race_thread, &racers[i]);
+	}
+	for (int i = 0; i < threads; i++) {
+		pthread_join(thread_ids[i], NULL);
+	}
+	uint64_t usec = timer_end(t);
+
+	for (int i = 0; i < threads; i++) {
+		mpz_clear(racers[i].p);
+	}
+	return usec;
+}
+
+/**
+ * @brief Factor one key alone on rho_batch, a walk on every lane.
+ */
+uint64_t time_batch_one(rsa_keys_t *keys)
+{
+	mpz_t p;
+	mpz_init(p);
+	struct timespec t = timer_start();
+	rho_batch_race(&keys->n, &p, NULL);
+	uint64_t usec = timer_end(t);
+	mpz_clear(p);
+	return usec;
+}
+
+/**
+ * @brief Factor one key with cfrac on the profile's thread count.
+ */
+uint64_t time_cfrac(rsa_keys_t *keys)
+{
+	int found = 0;
+	rsa_decrypt_t thread_struct = {0};
+	mpz_init(thread_struct.p);
+	thread_struct.found = &found;
+	struct timespec t = timer_start();
+	cfrac(keys->n, &thread_struct);
+	uint64_t usec = timer_end(t);
+	mpz_clear(thread_struct.p);
+	return usec;
+}
+
+/**
+ * @brief Factor the whole trial corpus with rho_batch.
+ */
+uint64_t time_corpus(mpz_t *n, mpz_t *p, int count, int threads)
+{
+	struct timespec t = timer_start();
+	rho_batch(n, p, count, threads, NULL);
+	return timer_end(t);
+}
+
+/**
+ * @brief Time codebook_decrypt on a make-test style message and return
+ *   ns per candidate block.
+ */
+double time_codebook(unsigned long seed)
+{
+	rsa_keys_t keys;
+	char message[256] = "<h1>autotune codebook trial</h1>"; // zero padded
+	char encrypted[512] = {0}, decrypted[512];
+
+	make_keys(&keys, 1, CODEBOOK_BITS, seed);
+	int len = rsa_encrypt(message, encrypted, strlen(message) + 1, &keys);
+
+	int ok = 1;
+	long reps = 0;
+	uint64_t usec = 0;
+	struct timespec t = timer_start();
+	while (ok && usec < CODEBOOK_USEC) {
+		ok = codebook_decrypt(&keys, encrypted, len, decrypted) >= 0;
+		reps++;
+		usec = timer_end(t);
+	}
+
+	// the padded last block makes it enumerate every printable run length
+	double candidates = 0;
+	for (unsigned int m = 0; m <= keys.enc_block_size; m++) {
+		candidates += pow(95, m);
+	}
+	free_keys(&keys, 1);
+	return ok ? usec * 1000.0 / (candidates * reps) : 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *fname = TUNE_PROFILE;
+	int max_bits = 80;
+	unsigned long seed = 1;
+	int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	tune_profile_t profile;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "o:m:s:")) != -1) {
+		switch (opt) {
+		case 'o': fname = optarg; break;
+		case 'm': max_bits = atoi(optarg); break;
+		case 's': seed = strtoul(optarg, NULL, 0); break;
+		default:
+			printf("Usage: %s [-o profile] [-m max_bits] [-s seed]\n", argv[0]);
+			exit(-1);
+		}
+	}
+
+	if (max_bits < 32) {
+		printf("Error - max_bits must be at least 32\n");
+		exit(-1);
+	}
+
+	tune_defaults(&profile);
+	tune_apply(&profile);
+	printf("Tuning on %d CPUs, key classes 32..%d bits\n", cpus, max_bits);
+
+	// trial corpus for the rho_batch knobs
+	rsa_keys_t corpus[CORPUS_KEYS];
+	mpz_t n[CORPUS_KEYS], p[CORPUS_KEYS];
+	make_keys(corpus, CORPUS_KEYS, CORPUS_BITS, seed);
+	for (int i = 0; i < CORPUS_KEYS; i++) {
+		mpz_init_set(n[i], corpus[i].n);
+		mpz_init(p[i]);
+	}
+
+	// 1. Montgomery kernel, with rho_batch kept on montlane
+	uint64_t best = UINT64_MAX;
+	const char *name;
+	snprintf(tune_profile.rho_kernel, sizeof(tune_profile.rho_kernel), "montlane");
+	for (int k = 0; (name = mont_kernel_name(k)) != NULL; k++) {
+		if (!mont_select_kernel(name)) {
+			printf("  kernel %-8s not supported\n", name);
+			continue;
+		}
+		uint64_t usec = time_corpus(n, p, CORPUS_KEYS, 1);
+		printf("  kernel %-8s %8.3f sec\n", name, usec / 1e6);
+		if (usec < best) {
+			best = usec;
+			snprintf(profile.kernel, sizeof(profile.kernel), "%s", name);
+		}
+	}
+	tune_apply(&profile);
+	printf("kernel %s\n", profile.kernel);
+
+	// 2. rho_batch step kernel: a radix 2^52 one or montlane's steps
+	best = UINT64_MAX;
+	for (int k = 0; ; k++) {
+		int last = (name = rho52_kernel_name(k)) == NULL;
+		if (last) {
+			name = "montlane";
+		} else if (!rho52_select_kernel(name)) {
+			printf("  rho kernel %-10s not supported\n", name);
+			continue;
+		}
+		snprintf(tune_profile.rho_kernel, sizeof(tune_profile.rho_kernel), "%s", name);
+		uint64_t usec = time_corpus(n, p, CORPUS_KEYS, 1);
+		printf("  rho kernel %-10s %8.3f sec\n", name, usec / 1e6);
+		if (usec < best) {
+			best = usec;
+			snprintf(profile.rho_kernel, sizeof(profile.rho_kernel), "%s", name);
+		}
+		if (last) {
+			break;
+		}
+	}
+	tune_apply(&profile);
+	printf("rho_kernel %s\n", profile.rho_kernel);
+
+	// 3. gcd batch length
+	best = UINT64_MAX;
+	for (int gcd = 16; gcd <= 1024; gcd *= 2) {
+		tune_profile.rho_batch_gcd = gcd;
+		uint64_t usec = time_corpus(n, p, CORPUS_KEYS, 1);
+		printf("  gcd every %4d steps %8.3f sec\n", gcd, usec / 1e6);
+		if (usec < best) {
+			best = usec;
+			profile.rho_batch_gcd = gcd;
+		}
+	}
+	tune_apply(&profile);
+	printf("rho_batch_gcd %d\n", profile.rho_batch_gcd);
+
+	// 4. rho_batch workers, up to two per CPU
+	best = UINT64_MAX;
+	for (int threads = 1; threads <= 2 * cpus && threads <= TUNE_MAX_THREADS; threads *= 2) {
+		uint64_t usec = time_corpus(n, p, CORPUS_KEYS, threads);
+		printf("  %2d batch threads %8.3f sec\n", threads, usec / 1e6);
+		if (usec < best) {
+			best = usec;
+			profile.batch_threads = threads;
+		}
+	}
+	printf("batch_threads %d\n", profile.batch_threads);
+
+	// per class: pollardRho threads and the cost of each engine
+	key_class_t classes[MAX_CLASSES];
+	int num_classes = 0;
+	for (int bits = 32; bits <= max_bits && num_classes < MAX_CLASSES; bits += 8) {
+		classes[num_classes].bits = bits;
+		make_keys(classes[num_classes].keys, CLASS_KEYS, bits, seed);
+		num_classes++;
+	}
+
+	// 5. pollardRho threads racing on one key, timed on a mid-size class
+	key_class_t *mid = &classes[num_classes / 2];
+	best = UINT64_MAX;
+	for (int threads = 1; threads <= cpus && threads <= TUNE_MAX_THREADS; threads *= 2) {
+		uint64_t usec = 0;
+		for (int i = 0; i < CLASS_KEYS; i++) {
+			usec += time_race(&mid->keys[i], threads);
+		}
+		printf("  %2d rho threads at %d bits %8.3f sec\n", threads, mid->bits, usec / 1e6);
+		if (usec < best) {
+			best = usec;
+			profile.threads = threads;
+		}
+	}
+	printf("threads %d\n", profile.threads);
+
+	// 6. cost model: fit ns per model iteration (or unit) for each engine
+	tune_profile.threads = profile.threads;
+	double rho_usec[MAX_CLASSES], batch_usec[MAX_CLASSES], cfrac_usec[MAX_CLASSES];
+	double rho_total = 0, batch_total = 0, cfrac_total = 0, iterations = 0, units = 0;
+	for (int c = 0; c < num_classes; c++) {
+		rho_usec[c] = batch_usec[c] = cfrac_usec[c] = 0;
+		for (int i = 0; i < CLASS_KEYS; i++) {
+			rho_usec[c] += time_race(&classes[c].keys[i], profile.threads);
+			batch_usec[c] += time_batch_one(&classes[c].keys[i]);
+			cfrac_usec[c] += time_cfrac(&classes[c].keys[i]);
+		}
+		rho_usec[c] /= CLASS_KEYS;
+		batch_usec[c] /= CLASS_KEYS;
+		cfrac_usec[c] /= CLASS_KEYS;
+		rho_total += rho_usec[c];
+		batch_total += batch_usec[c];
+		cfrac_total += cfrac_usec[c];
+		iterations += tune_rho_iterations(classes[c].bits);
+		units += tune_cfrac_units(classes[c].bits);
+		printf("  %3d bits: pollardRho %10.0f usec, rho_batch %10.0f usec, cfrac %10.0f usec per key\n",
+			classes[c].bits, rho_usec[c], batch_usec[c], cfrac_usec[c]);
+	}
+	profile.rho_ns_per_iteration = rho_total * 1000 / iterations;
+	profile.batch_ns_per_iteration = batch_total * 1000 / iterations;
+	profile.cfrac_ns_per_unit = cfrac_total * 1000 / units;
+	printf("rho_ns_per_iteration %.1f\nbatch_ns_per_iteration %.1f\ncfrac_ns_per_unit %.3f\n",
+		profile.rho_ns_per_iteration, profile.batch_ns_per_iteration, profile.cfrac_ns_per_unit);
+
+	double ns = time_codebook(seed);
+	if (ns > 0) {
+		profile.codebook_ns_per_candidate = ns;
+	}
+	printf("codebook_ns_per_candidate %.1f\n", profile.codebook_ns_per_candidate);
+
+	// 7. crossover: the smallest class from which rho_batch always wins
+	profile.rho_batch_min_bits = 0;
+	for (int c = num_classes - 1; c >= 0 && batch_usec[c] < rho_usec[c]; c--) {
+		profile.rho_batch_min_bits = classes[c].bits;
+	}
+	printf("rho_batch_min_bits %d\n", profile.rho_batch_min_bits);
+
+	// 8. and from which cfrac beats both; it only pulls ahead with size,
+	// so if it loses even at the largest class the crossover goes just
+	// past it rather than below keys it was measured to lose on
+	profile.cfrac_min_bits = classes[num_classes - 1].bits + 8;
+	for (int c = num_classes - 1; c >= 0 && cfrac_usec[c] < fmin(rho_usec[c], batch_usec[c]); c--) {
+		profile.cfrac_min_bits = classes[c].bits;
+	}
+	printf("cfrac_min_bits %d\n", profile.cfrac_min_bits);
+
+	tune_save(fname, &profile);
+	tune_apply(&profile);
+	printf("Wrote %s\n\n", fname);
+
+	// predicted against measured, on keys the tuner has not seen
+	printf(" bits  engine      predicted usec  measured usec  ratio\n");
+	for (int c = 0; c < num_classes; c++) {
+		int bits = classes[c].bits;
+		int use_cfrac = tune_use_cfrac(&profile, bits);
+		int batch = tune_use_rho_batch(&profile, bits);
+		rsa_keys_t keys[CLASS_KEYS];
+		make_keys(keys, CLASS_KEYS, bits, seed + 1);
+
+		double measured = 0;
+		for (int i = 0; i < CLASS_KEYS; i++) {
+			measured += use_cfrac ? time_cfrac(&keys[i]) :
+				batch ? time_batch_one(&keys[i]) : time_race(&keys[i], profile.threads);
+		}
+		measured /= CLASS_KEYS;
+		double predicted = rho_predicted_usec(&keys[0]);
+		printf("%5d  %-10s  %14.0f  %13.0f  %5.2f\n", bits,
+			use_cfrac ? "cfrac" : batch ? "rho_batch" : "pollardRho",
+			predicted, measured, measured / predicted);
+		free_keys(keys, CLASS_KEYS);
+	}
+
+	for (int c = 0; c < num_classes; c++) {
+		free_keys(classes[c].keys, CLASS_KEYS);
+	}
+	for (int i = 0; i < CORPUS_KEYS; i++) {
+		mpz_clears(n[i], p[i], NULL);
+	}
+	free_keys(corpus, CORPUS_KEYS);
+	return 0;
+}
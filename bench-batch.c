@@ -0,0 +1,113 @@
+/**
+ * @file bench-batch.c
+ * @brief Compare the scalar rsa_encrypt/rsa_decrypt path against the
+ *   lane-parallel batch variants, in blocks per second.
+ * @version 0.1
+ * @date 2021-05-20
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "rsa.h"
+
+#define MSG_LEN 4096       // Bytes of clear text per round
+#define MIN_USEC 200000    // Run each measurement at least this long
+
+struct timespec timer_start()
+{
+	struct timespec tick;
+	clock_gettime(CLOCK_MONOTONIC, &tick);
+	return tick;
+}
+
+uint64_t timer_end(struct timespec tick)
+{
+	struct timespec tock;
+	clock_gettime(CLOCK_MONOTONIC, &tock);
+	uint64_t start_nanos = tick.tv_sec * (long)1e9 + tick.tv_nsec;
+	uint64_t end_nanos = tock.tv_sec * (long)1e9 + tock.tv_nsec;
+
+	return (end_nanos - start_nanos) / 1000;
+}
+
+typedef size_t (*crypt_fn)(char *, char *, int, rsa_keys_t *);
+
+// Run fn over the input until MIN_USEC has passed, return blocks/sec
+double blocks_per_sec(crypt_fn fn, char *in, char *out, int in_len,
+	int block_size, rsa_keys_t *keys)
+{
+	uint64_t usec = 0;
+	long rounds = 0;
+	struct timespec t = timer_start();
+
+	while (usec < MIN_USEC) {
+		fn(in, out, in_len, keys);
+		rounds++;
+		usec = timer_end(t);
+	}
+
+	long blocks = rounds * ((in_len + block_size - 1) / block_size);
+	return blocks * 1e6 / usec;
+}
+
+int main(void)
+{
+	int keysize[] = {32, 64, 100, 128, 200, 256, 384, 512};
+	int num_sizes = sizeof(keysize) / sizeof(keysize[0]);
+
+	char *message = malloc(MSG_LEN);
+	char *scalar = malloc(MSG_LEN * 8);
+	char *batch = malloc(MSG_LEN * 8);
+	char *clear = malloc(MSG_LEN * 8);
+
+	srand(1);
+	for (int i = 0; i < MSG_LEN; i++) {
+		message[i] = ' ' + rand() % 95;
+	}
+
+	printf("%5s %14s %14s %8s %14s %14s %8s\n", "bits",
+		"enc scalar/s", "enc batch/s", "speedup",
+		"dec scalar/s", "dec batch/s", "speedup");
+
+	for (int j = 0; j < num_sizes; j++) {
+		rsa_keys_t keys;
+		rsa_genkeys(keysize[j], &keys);
+
+		// make sure both paths agree before timing them
+		int enc_len = rsa_encrypt(message, scalar, MSG_LEN, &keys);
+		int batch_len = rsa_encrypt_batch(message, batch, MSG_LEN, &keys);
+		rsa_decrypt_batch(batch, clear, batch_len, &keys);
+		if (enc_len != batch_len || memcmp(scalar, batch, enc_len) != 0 ||
+			memcmp(message, clear, MSG_LEN) != 0) {
+			printf("%d bit key: batch output does not match scalar\n", keysize[j]);
+			exit(-1);
+		}
+
+		double enc_scalar = blocks_per_sec(rsa_encrypt, message, scalar,
+			MSG_LEN, keys.enc_block_size, &keys);
+		double enc_batch = blocks_per_sec(rsa_encrypt_batch, message, batch,
+			MSG_LEN, keys.enc_block_size, &keys);
+		double dec_scalar = blocks_per_sec(rsa_decrypt, scalar, clear,
+			enc_len, keys.dec_block_size, &keys);
+		double dec_batch = blocks_per_sec(rsa_decrypt_batch, scalar, clear,
+			enc_len, keys.dec_block_size, &keys);
+
+		printf("%5d %14.0f %14.0f %7.2fx %14.0f %14.0f %7.2fx\n", keysize[j],
+			enc_scalar, enc_batch, enc_batch / enc_scalar,
+			dec_scalar, dec_batch, dec_batch / dec_scalar);
+
+		mpz_clears(keys.p, keys.q, keys.n, keys.d, keys.e, NULL);
+	}
+
+	free(message);
+	free(scalar);
+	free(batch);
+	free(clear);
+	return 0;
+}
@@ -0,0 +1,136 @@
+/**
+ * @file bench-cfrac.c
+ * @brief Time-to-factor and peak memory of the CFRAC engine per key
+ *   size, next to what the cost model predicts for it and for
+ *   pollardRho.  Every
+ *   size runs in its own child process so its peak RSS is its own.
+ *
+ *   Usage: bench-cfrac [-b min_bits] [-m max_bits] [-d step] [-n keys]
+ *     [-t threads] [-s seed]
+ * @version 0.1
+ * @date 2021-05-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "rsa.h"
+#include "cfrac.h"
+#include "tune.h"
+
+struct timespec timer_start()
+{
+	struct timespec tick;
+	clock_gettime(CLOCK_MONOTONIC, &tick);
+	return tick;
+}
+
+uint64_t timer_end(struct timespec tick)
+{
+	struct timespec tock;
+	clock_gettime(CLOCK_MONOTONIC, &tock);
+	uint64_t start_nanos = tick.tv_sec * (long)1e9 + tick.tv_nsec;
+	uint64_t end_nanos = tock.tv_sec * (long)1e9 + tock.tv_nsec;
+
+	return (end_nanos - start_nanos) / 1000;
+}
+
+/**
+ * @brief Factor count fresh keys of one size, print the mean time.
+ *
+ * @return 0 if every key was factored correctly.
+ */
+int bench_size(int bits, int count, unsigned long seed)
+{
+	gmp_randstate_t state;
+	gmp_randinit_mt(state);
+	gmp_randseed_ui(state, seed * 1000 + bits);
+
+	uint64_t total = 0;
+	int failed = 0;
+	for (int i = 0; i < count; i++) {
+		rsa_keys_t keys;
+		rsa_genkeys_state(bits, &keys, state);
+
+		int found = 0;
+		rsa_decrypt_t thread_struct = {0};
+		mpz_init(thread_struct.p);
+		thread_struct.found = &found;
+
+		struct timespec t = timer_start();
+		cfrac(keys.n, &thread_struct);
+		total += timer_end(t);
+
+		if (mpz_cmp(thread_struct.p, keys.p) != 0 && mpz_cmp(thread_struct.p, keys.q) != 0) {
+			gmp_printf("Error - cfrac gave %Zd for %Zd\n", thread_struct.p, keys.n);
+			failed = 1;
+		}
+		mpz_clear(thread_struct.p);
+		mpz_clears(keys.p, keys.q, keys.n, keys.d, keys.e, NULL);
+	}
+	gmp_randclear(state);
+
+	double model = tune_cfrac_units(bits) * tune_profile.cfrac_ns_per_unit / 1e9;
+	double rho = tune_rho_iterations(bits) * tune_profile.rho_ns_per_iteration / 1e9;
+	printf("%5d %10.3f %10.3f %14.0f", bits, total / 1e6 / count, model, rho);
+	fflush(stdout);
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	tune_load(TUNE_PROFILE, &tune_profile);
+	tune_apply(&tune_profile);
+
+	int min_bits = 64, max_bits = 128, step = 8, count = 4;
+	unsigned long seed = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:m:d:n:t:s:")) != -1) {
+		switch (opt) {
+		case 'b': min_bits = atoi(optarg); break;
+		case 'm': max_bits = atoi(optarg); break;
+		case 'd': step = atoi(optarg); break;
+		case 'n': count = atoi(optarg); break;
+		case 't': tune_profile.threads = atoi(optarg); break;
+		case 's': seed = strtoul(optarg, NULL, 0); break;
+		default:
+			printf("Usage: %s [-b min_bits] [-m max_bits] [-d step] [-n keys] [-t threads] [-s seed]\n", argv[0]);
+			exit(-1);
+		}
+	}
+	if (step < 1 || count < 1 || tune_profile.threads < 1 || tune_profile.threads > TUNE_MAX_THREADS) {
+		printf("Error - bad step, key count or thread count\n");
+		exit(-1);
+	}
+
+	printf("cfrac on %d threads, %d keys per size\n", tune_profile.threads, count);
+	printf(" bits  cfrac sec  model sec  rho model sec  peak RSS KB\n");
+	int failed = 0;
+	for (int bits = min_bits; bits <= max_bits; bits += step) {
+		fflush(stdout);
+		pid_t pid = fork();
+		if (pid < 0) {
+			perror("could not fork");
+			exit(-1);
+		}
+		if (pid == 0) {
+			exit(bench_size(bits, count, seed));
+		}
+
+		int status;
+		struct rusage usage;
+		wait4(pid, &status, 0, &usage);
+		printf(" %12ld\n", usage.ru_maxrss);
+		failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+	}
+
+	return failed;
+}
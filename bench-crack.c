@@ -0,0 +1,274 @@
+/**
+ * @file bench-crack.c
+ * @brief Measure the async API in crack.h against calling pollardRho
+ *   directly: the same keys one call at a time, each key timed both ways
+ *   back to back after a warm-up pass so the median difference is the
+ *   per-call overhead, then all submitted at once, with their ciphertexts, to -t pool
+ *   threads.  Every factor and message is checked and every callback
+ *   counted.  Last it cancels a running and a queued job on keys
+ *   pollardRho cannot finish and checks that every GMP block they
+ *   allocated was freed.
+ *
+ *   Usage: bench-crack [-b bits] [-n keys] [-t threads]
+ *
+ *   The Fermat pass and cfrac are turned off so both sides run the same
+ *   pollardRho walk.
+ * @version 0.1
+ * @date 2021-06-04
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "rsa.h"
+#include "primefact.h"
+#include "crack.h"
+#include "tune.h"
+
+#define MESSAGE "<h1>attack at dawn</h1>"
+
+// GMP blocks allocated and not yet freed, over every thread
+static long live_blocks;
+
+struct timespec timer_start()
+{
+	struct timespec tick;
+	clock_gettime(CLOCK_MONOTONIC, &tick);
+	return tick;
+}
+
+uint64_t timer_end(struct timespec tick)
+{
+	struct timespec tock;
+	clock_gettime(CLOCK_MONOTONIC, &tock);
+	uint64_t start_nanos = tick.tv_sec * (long)1e9 + tick.tv_nsec;
+	uint64_t end_nanos = tock.tv_sec * (long)1e9 + tock.tv_nsec;
+
+	return (end_nanos - start_nanos) / 1000;
+}
+
+void *count_alloc(size_t size)
+{
+	__atomic_add_fetch(&live_blocks, 1, __ATOMIC_RELAXED);
+	return malloc(size);
+}
+
+void *count_realloc(void *p, size_t old_size, size_t new_size)
+{
+	(void)old_size;
+	return realloc(p, new_size);
+}
+
+void count_free(void *p, size_t size)
+{
+	(void)size;
+	__atomic_sub_fetch(&live_blocks, 1, __ATOMIC_RELAXED);
+	free(p);
+}
+
+void count_done(crack_job_t *job, void *arg)
+{
+	(void)job;
+	__atomic_add_fetch((int *)arg, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Check a finished job's factors, and its message against the one
+ *   that was encrypted.
+ */
+void check(crack_job_t *job, int i, int with_message)
+{
+	const crack_result_t *r = crack_result(job);
+	if (r->status != CRACK_DONE || mpz_divisible_p(r->keys.n, r->keys.p) == 0 ||
+		mpz_cmp_ui(r->keys.p, 1) <= 0 || mpz_cmp(r->keys.p, r->keys.n) >= 0 ||
+		(with_message && (r->message == NULL || strcmp(r->message, MESSAGE) != 0))) {
+		printf("Error - key %d finished with status %d\n", i, r->status);
+		exit(-1);
+	}
+}
+
+int cmp_long(const void *a, const void *b)
+{
+	long x = *(const long *)a, y = *(const long *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * @brief Factor one key with pollardRho, the factoring alone.
+ */
+uint64_t time_direct(rsa_keys_t *keys, rsa_decrypt_t *thread_struct)
+{
+	struct timespec t = timer_start();
+	*thread_struct->found = 0;
+	pollardRho(keys->n, thread_struct);
+	return timer_end(t);
+}
+
+/**
+ * @brief The same walk through submit and wait, without the ciphertext so
+ *   only the private key is added to the work.
+ */
+uint64_t time_api(crack_pool_t *pool, rsa_keys_t *keys, int i, int *callbacks)
+{
+	struct timespec t = timer_start();
+	crack_job_t *job = crack_submit(pool, keys, NULL, 0, count_done, callbacks);
+	crack_wait(job, -1);
+	uint64_t usec = timer_end(t);
+	check(job, i, 0);
+	crack_release(job);
+	return usec;
+}
+
+int main(int argc, char **argv)
+{
+	int bits = 40, count = 200, threads = 2;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:n:t:")) != -1) {
+		switch (opt) {
+		case 'b': bits = atoi(optarg); break;
+		case 'n': count = atoi(optarg); break;
+		case 't': threads = atoi(optarg); break;
+		default: argc = 0;
+		}
+	}
+	if (argc == 0 || optind != argc || bits < 16 || count < 1 || threads < 1) {
+		printf("Usage: %s [-b bits] [-n keys] [-t threads]\n", argv[0]);
+		exit(-1);
+	}
+	mp_set_memory_functions(count_alloc, count_realloc, count_free);
+
+	tune_load(TUNE_PROFILE, &tune_profile);
+	tune_profile.fermat_budget = 0;
+	tune_profile.cfrac_min_bits = 0;
+	tune_apply(&tune_profile);
+
+	// keys and one message encrypted under each
+	rsa_keys_t *keys = malloc(count * sizeof(rsa_keys_t));
+	char **encrypted = malloc(count * sizeof(char *));
+	int *enc_len = malloc(count * sizeof(int));
+	gmp_randstate_t state;
+	gmp_randinit_mt(state);
+	gmp_randseed_ui(state, bits);
+	for (int i = 0; i < count; i++) {
+		rsa_genkeys_state(bits, &keys[i], state);
+		int len = strlen(MESSAGE) + 1;
+		int blocks = (len + keys[i].enc_block_size - 1) / keys[i].enc_block_size;
+		char *padded = calloc(blocks, keys[i].enc_block_size);
+		strcpy(padded, MESSAGE);
+		encrypted[i] = malloc((size_t)blocks * keys[i].dec_block_size);
+		enc_len[i] = rsa_encrypt(padded, encrypted[i], blocks * keys[i].enc_block_size, &keys[i]);
+		free(padded);
+	}
+
+	// 1. each key directly and through submit + wait, back to back and
+	// alternating which goes first, after one untimed pass of both so
+	// neither side pays for cold caches and page faults
+	rsa_decrypt_t thread_struct = {0};
+	int found;
+	thread_struct.found = &found;
+	mpz_init(thread_struct.p);
+	int callbacks = 0;
+	crack_pool_t *pool = crack_pool_create(1, 4);
+	for (int i = 0; i < count; i++) {
+		time_direct(&keys[i], &thread_struct);
+		time_api(pool, &keys[i], i, &callbacks);
+	}
+	long *overhead = malloc(count * sizeof(long));
+	uint64_t direct_usec = 0, serial_usec = 0;
+	for (int i = 0; i < count; i++) {
+		uint64_t direct, api;
+		if (i & 1) {
+			api = time_api(pool, &keys[i], i, &callbacks);
+			direct = time_direct(&keys[i], &thread_struct);
+		} else {
+			direct = time_direct(&keys[i], &thread_struct);
+			api = time_api(pool, &keys[i], i, &callbacks);
+		}
+		direct_usec += direct;
+		serial_usec += api;
+		overhead[i] = (long)api - (long)direct;
+	}
+	qsort(overhead, count, sizeof(long), cmp_long);
+	crack_pool_destroy(pool);
+	mpz_clear(thread_struct.p);
+
+	// 2. everything at once on the pool, decrypting each message
+	crack_job_t **jobs = malloc(count * sizeof(crack_job_t *));
+	pool = crack_pool_create(threads, count);
+	struct timespec t = timer_start();
+	for (int i = 0; i < count; i++) {
+		jobs[i] = crack_submit(pool, &keys[i], encrypted[i], enc_len[i], count_done, &callbacks);
+	}
+	for (int i = 0; i < count; i++) {
+		crack_wait(jobs[i], -1);
+		check(jobs[i], i, 1);
+		crack_release(jobs[i]);
+	}
+	uint64_t pool_usec = timer_end(t);
+	crack_pool_destroy(pool);
+
+	if (callbacks != 3 * count) {
+		printf("Error - %d callbacks for %d jobs\n", callbacks, 3 * count);
+		exit(-1);
+	}
+	printf("%d %d-bit keys\n", count, bits);
+	printf("pollardRho direct:   %10.3f sec, %8.1f usec per key\n", direct_usec / 1e6,
+		(double)direct_usec / count);
+	printf("submit + wait:       %10.3f sec, %8.1f usec per key, %ld usec median overhead per call\n",
+		serial_usec / 1e6, (double)serial_usec / count, overhead[count / 2]);
+	printf("pool of %2d threads:  %10.3f sec, %8.0f keys/sec\n", threads, pool_usec / 1e6,
+		count * 1e6 / (pool_usec ? pool_usec : 1));
+
+	// 3. cancel a running and a queued job on keys too large to finish
+	rsa_keys_t big[2];
+	for (int i = 0; i < 2; i++) {
+		rsa_genkeys_state(160, &big[i], state);
+	}
+	long before = __atomic_load_n(&live_blocks, __ATOMIC_RELAXED);
+	pool = crack_pool_create(1, 2);
+	crack_job_t *running = crack_submit(pool, &big[0], NULL, 0, count_done, &callbacks);
+	crack_job_t *queued = crack_submit(pool, &big[1], NULL, 0, count_done, &callbacks);
+	int status = crack_wait(running, 20000);
+	printf("after 20 ms: %s %s\n", status == CRACK_RUNNING ? "running" : "not running",
+		crack_poll(queued) == CRACK_PENDING ? "and queued" : "and not queued");
+
+	t = timer_start();
+	crack_cancel(queued);
+	crack_cancel(running);
+	int running_status = crack_wait(running, -1);
+	uint64_t cancel_usec = timer_end(t);
+	int queued_status = crack_wait(queued, -1);
+	crack_release(running);
+	crack_release(queued);
+	crack_pool_destroy(pool);
+	long after = __atomic_load_n(&live_blocks, __ATOMIC_RELAXED);
+
+	printf("cancelled in %.3f ms, %ld GMP blocks left over\n", cancel_usec / 1e3, after - before);
+	if (running_status != CRACK_CANCELLED || queued_status != CRACK_CANCELLED || after != before) {
+		printf("Error - cancelling left status %d/%d and %ld GMP blocks\n", running_status,
+			queued_status, after - before);
+		exit(-1);
+	}
+
+	for (int i = 0; i < count; i++) {
+		mpz_clears(keys[i].p, keys[i].q, keys[i].n, keys[i].d, keys[i].e, NULL);
+		free(encrypted[i]);
+	}
+	for (int i = 0; i < 2; i++) {
+		mpz_clears(big[i].p, big[i].q, big[i].n, big[i].d, big[i].e, NULL);
+	}
+	gmp_randclear(state);
+	free(keys);
+	free(encrypted);
+	free(enc_len);
+	free(jobs);
+	free(overhead);
+	return 0;
+}
@@ -0,0 +1,218 @@
+/**
+ * @file bench-place.c
+ * @brief Print the CPU topology place.c sees and compare the worker
+ *   placement policies (none, cores, threads).  Each policy runs with
+ *   its natural worker count (one per core or one per hardware thread)
+ *   unless -w is given, first on a plain GMP rho loop, x = x^2 + 1 mod n
+ *   as in pollardRho, for -s seconds per worker, then on rho_batch over
+ *   -n generated keys per worker.  Both are reported in iterations/sec.
+ *
+ *   Usage: bench-place [-b bits] [-n keys_per_worker] [-s seconds] [-w workers]
+ * @version 0.1
+ * @date 2021-06-02
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "rsa.h"
+#include "rhobatch.h"
+#include "tune.h"
+#include "place.h"
+
+typedef struct {
+	int policy;
+	int worker;
+	const mpz_t *n;
+	double seconds;
+	pthread_barrier_t *start;
+	uint64_t iterations;
+	int node;            // where the worker ended up, -1 unpinned
+} loop_worker_t;
+
+struct timespec timer_start()
+{
+	struct timespec tick;
+	clock_gettime(CLOCK_MONOTONIC, &tick);
+	return tick;
+}
+
+uint64_t timer_end(struct timespec tick)
+{
+	struct timespec tock;
+	clock_gettime(CLOCK_MONOTONIC, &tock);
+	uint64_t start_nanos = tick.tv_sec * (long)1e9 + tick.tv_nsec;
+	uint64_t end_nanos = tock.tv_sec * (long)1e9 + tock.tv_nsec;
+
+	return (end_nanos - start_nanos) / 1000;
+}
+
+/**
+ * @brief The pollardRho inner loop on one modulus until time runs out.
+ *   The mpz storage is first touched here, after pinning, so it lands on
+ *   the worker's node.
+ */
+void *loop_worker(void *input)
+{
+	loop_worker_t *w = (loop_worker_t *)input;
+	mpz_t x, t;
+
+	w->node = place_pin(w->policy, w->worker);
+	mpz_init_set_ui(x, 2 + w->worker);
+	mpz_init2(t, 2 * mpz_sizeinbase(*w->n, 2));
+	pthread_barrier_wait(w->start);
+
+	struct timespec tick = timer_start();
+	uint64_t limit = w->seconds * 1e6, steps = 0;
+	do {
+		for (int s = 0; s < 1024; s++) {
+			mpz_mul(t, x, x);
+			mpz_add_ui(t, t, 1);
+			mpz_mod(x, t, *w->n);
+		}
+		steps += 1024;
+	} while (timer_end(tick) < limit);
+
+	w->iterations = steps;
+	mpz_clears(x, t, NULL);
+	return NULL;
+}
+
+/**
+ * @brief Run the GMP loop on every worker at once.
+ *
+ * @return iterations/sec over all workers, timed from the barrier
+ *   releasing them to the last one finishing.
+ */
+double run_loop(int policy, int workers, const mpz_t *n, double seconds)
+{
+	pthread_t thread_ids[TUNE_MAX_THREADS];
+	pthread_barrier_t start;
+	loop_worker_t *w[TUNE_MAX_THREADS];
+	uint64_t iterations = 0;
+
+	pthread_barrier_init(&start, NULL, workers + 1);
+	for (int i = 0; i < workers; i++) {
+		w[i] = place_alloc(sizeof(loop_worker_t), place_node(policy, i));
+		w[i]->policy = policy;
+		w[i]->worker = i;
+		w[i]->n = &n[i];
+		w[i]->seconds = seconds;
+		w[i]->start = &start;
+		pthread_create(&thread_ids[i], NULL, loop_worker, w[i]);
+	}
+	pthread_barrier_wait(&start);
+	struct timespec t = timer_start();
+	for (int i = 0; i < workers; i++) {
+		pthread_join(thread_ids[i], NULL);
+	}
+	uint64_t usec = timer_end(t);
+	for (int i = 0; i < workers; i++) {
+		iterations += w[i]->iterations;
+		place_free(w[i], sizeof(loop_worker_t));
+	}
+	pthread_barrier_destroy(&start);
+	return iterations * 1e6 / (usec ? usec : 1);
+}
+
+/**
+ * @brief rho_batch over count keys with the profile's placement set to
+ *   policy.
+ *
+ * @return iterations/sec.
+ */
+double run_batch(int policy, int workers, mpz_t *n, mpz_t *p, size_t count)
+{
+	uint64_t iterations;
+	snprintf(tune_profile.placement, sizeof(tune_profile.placement), "%s", place_policy_name(policy));
+
+	struct timespec t = timer_start();
+	long factored = rho_batch(n, p, count, workers, &iterations);
+	uint64_t usec = timer_end(t);
+
+	if (factored != (long)count) {
+		printf("Error - rho_batch factored %ld of %zu keys\n", factored, count);
+		exit(-1);
+	}
+	return iterations * 1e6 / (usec ? usec : 1);
+}
+
+int main(int argc, char **argv)
+{
+	int bits = 64, per_worker = 64, fixed_workers = 0;
+	double seconds = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:n:s:w:")) != -1) {
+		switch (opt) {
+		case 'b': bits = atoi(optarg); break;
+		case 'n': per_worker = atoi(optarg); break;
+		case 's': seconds = atof(optarg); break;
+		case 'w': fixed_workers = atoi(optarg); break;
+		default: argc = 0;
+		}
+	}
+	if (argc == 0 || optind != argc || bits < 16 || per_worker < 1 || seconds <= 0 ||
+		fixed_workers < 0 || fixed_workers > TUNE_MAX_THREADS) {
+		printf("Usage: %s [-b bits] [-n keys_per_worker] [-s seconds] [-w workers]\n", argv[0]);
+		exit(-1);
+	}
+
+	tune_load(TUNE_PROFILE, &tune_profile);
+	tune_apply(&tune_profile);
+
+	const place_topology_t *topo = place_topology();
+	printf("%d cpus, %d cores, %d packages, %d nodes\n", topo->num_cpus, topo->num_cores,
+		topo->num_packages, topo->num_nodes);
+	for (int i = 0; i < topo->num_cpus; i++) {
+		const place_cpu_t *cpu = &topo->cpus[i];
+		printf("  cpu %3d: core %3d package %d node %d sibling %d\n", cpu->cpu, cpu->core,
+			cpu->package, cpu->node, cpu->sibling);
+	}
+
+	int workers[PLACE_POLICIES], most = 0;
+	for (int policy = 0; policy < PLACE_POLICIES; policy++) {
+		workers[policy] = fixed_workers ? fixed_workers : place_workers(policy);
+		if (workers[policy] > TUNE_MAX_THREADS) workers[policy] = TUNE_MAX_THREADS;
+		if (workers[policy] > most) most = workers[policy];
+	}
+
+	// one key set for every policy, rho_batch only needs the moduli
+	size_t count = (size_t)most * per_worker;
+	mpz_t *n = malloc(count * sizeof(mpz_t));
+	mpz_t *p = malloc(count * sizeof(mpz_t));
+	gmp_randstate_t state;
+	gmp_randinit_mt(state);
+	gmp_randseed_ui(state, bits);
+	for (size_t i = 0; i < count; i++) {
+		rsa_keys_t keys;
+		rsa_genkeys_state(bits, &keys, state);
+		mpz_init_set(n[i], keys.n);
+		mpz_init(p[i]);
+		mpz_clears(keys.p, keys.q, keys.n, keys.d, keys.e, NULL);
+	}
+	gmp_randclear(state);
+
+	printf("%d-bit keys, %.1f s GMP loop, %d keys per rho_batch worker\n", bits, seconds, per_worker);
+	printf("policy   workers   GMP it/sec  per worker   rho_batch it/sec  per worker\n");
+	for (int policy = 0; policy < PLACE_POLICIES; policy++) {
+		int k = workers[policy];
+		double loop = run_loop(policy, k, (const mpz_t *)n, seconds);
+		double batch = run_batch(policy, k, n, p, (size_t)k * per_worker);
+		printf("%-8s %7d %12.0f %11.0f %18.0f %11.0f\n", place_policy_name(policy), k,
+			loop, loop / k, batch, batch / k);
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		mpz_clears(n[i], p[i], NULL);
+	}
+	free(n);
+	free(p);
+	return 0;
+}
@@ -0,0 +1,662 @@
+/**
+ * @file cfrac.c
+ * @brief Continued fraction factoring (Morrison-Brillhart).  The
+ *   expansion of sqrt(kn) gives A^2 = +-Q (mod n) with Q < 2 sqrt(kn),
+ *   small enough to be smooth over a factor base now and then; a set
+ *   of relations whose Q multiply to a square splits n.  Parts:
+ *
+ *   - Knuth-Schroeppel choice of the multipliers k
+ *   - trial division of Q with an early abort after the small primes
+ *   - one large prime per relation, partials with the same large prime
+ *     pair up into full relations
+ *   - Gaussian elimination over GF(2) on a bit-packed matrix
+ *
+ *   The expansion itself is sequential, so each thread expands sqrt(kn)
+ *   for its own multiplier and all of them feed one relation pool.
+ *   Memory is the factor base, the relations and the matrix, a few MB
+ *   up to 160 bits.
+ * @version 0.1
+ * @date 2021-05-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "cfrac.h"
+#include "tune.h"
+#include "place.h"
+
+#define CFRAC_FB_SCALE 0.30    // factor base size exp(scale * sqrt(ln n ln ln n))
+#define CFRAC_FB_MIN 64
+#define CFRAC_STAGE1_PRIMES 24  // primes tried before the early abort
+#define CFRAC_ABORT_KEEP 0.78   // Q must be down to this share of its bits by then
+#define CFRAC_BUCKETS (1 << 16) // partial relation hash buckets
+#define CFRAC_MAX_FACTORS 160   // prime factors of one Q, with the sign
+#define CFRAC_CHECK_STEPS 256   // steps between looks at the stop flags
+#define CFRAC_SCORE_LIMIT 320   // the multiplier score looks at primes below this
+
+typedef unsigned __int128 u128;
+typedef __int128 s128;
+
+// One factor base prime, with its inverses for trial division
+typedef struct {
+  uint32_t p;
+  uint64_t inv;     // p^-1 mod 2^64
+  uint64_t limit;   // UINT64_MAX / p, for the divisibility test
+  u128 inv128;      // p^-1 mod 2^128, for exact division
+} cfrac_prime_t;
+
+// A^2 = Q (mod n), Q over the factor base times large^2.  Partial
+// relations hold Q over the factor base times large instead.
+typedef struct {
+  mpz_t a;
+  uint32_t *factors; // factor base columns, once per power; 0 is -1
+  int count;
+  uint64_t large;    // 1 if none
+  int next;          // next partial in the same bucket
+} cfrac_rel_t;
+
+typedef struct {
+  mpz_srcptr n;
+  cfrac_prime_t *fb; // fb[0] stands for -1, fb[1] is 2
+  int columns;
+  uint64_t large_max;
+
+  cfrac_rel_t *rels;
+  int num_rels, cap_rels, target;
+  cfrac_rel_t *partials;
+  int num_partials, cap_partials;
+  int *buckets;
+
+  int *found;        // the caller's flag, set by whoever factors n
+  int placement;     // policy the workers are pinned under
+  int stop;
+  uint64_t steps;
+  pthread_mutex_t lock;
+} cfrac_t;
+
+// One expansion of sqrt(kn), resumable across rounds
+typedef struct {
+  cfrac_t *cf;
+  int id;            // worker number, for place_pin
+  unsigned long k;
+  uint32_t *primes;  // columns whose prime can divide Q for this k
+  int num_primes;
+  int abort_bits;
+  u128 g, P, Q, Qprev;
+  mpz_t a, aprev;    // A_{i-1} and A_{i-2} mod n
+  unsigned long i;
+  int done;          // hit the end of the period
+} cfrac_worker_t;
+
+static int u128_bits(u128 x) {
+  uint64_t hi = (uint64_t)(x >> 64);
+  return hi ? 128 - __builtin_clzll(hi) : (uint64_t)x ? 64 - __builtin_clzll((uint64_t)x) : 0;
+}
+
+static u128 mpz_get_u128(const mpz_t a) {
+  uint64_t words[2] = {0, 0};
+  mpz_export(words, NULL, -1, sizeof(uint64_t), 0, 0, a);
+  return (u128)words[1] << 64 | words[0];
+}
+
+static void mpz_set_u128(mpz_t r, u128 x) {
+  uint64_t words[2] = {(uint64_t)x, (uint64_t)(x >> 64)};
+  mpz_import(r, 2, -1, sizeof(uint64_t), 0, 0, words);
+}
+
+// Whether odd p divides x = hi 2^64 + lo: with q0 p = h 2^64 + lo,
+// x - q0 p = (hi - h) 2^64, so p | x exactly when p | hi - h.
+static inline int divides(const cfrac_prime_t *fp, u128 x) {
+  uint64_t lo = (uint64_t)x, hi = (uint64_t)(x >> 64);
+  uint64_t h = (uint64_t)(((u128)(lo * fp->inv) * fp->p) >> 64);
+  int64_t d = (int64_t)(hi - h);
+  uint64_t ad = d < 0 ? -(uint64_t)d : (uint64_t)d;
+  return ad * fp->inv <= fp->limit;
+}
+
+static int is_small_prime(uint32_t q) {
+  for (uint32_t d = 2; d * d <= q; d++) {
+    if (q % d == 0) {
+      return 0;
+    }
+  }
+  return q >= 2;
+}
+
+// Odd primes the multiplier score looks at, with n mod p and a bitmap
+// of the quadratic residues mod p
+typedef struct {
+  uint32_t p;
+  uint32_t nmod;
+  uint64_t residue[(CFRAC_SCORE_LIMIT + 63) / 64];
+} cfrac_score_prime_t;
+
+/**
+ * @brief Knuth-Schroeppel score of multiplier k: expected log of the
+ *   small prime part of Q less the cost of Q growing by sqrt(k).
+ */
+static double multiplier_score(unsigned long nmod8, const cfrac_score_prime_t *primes, int count,
+                               unsigned long k) {
+  double score = -0.5 * log(k);
+  switch (nmod8 * k % 8) {
+  case 1: score += 2 * log(2); break;
+  case 5: score += log(2); break;
+  case 3: case 7: score += 0.5 * log(2); break;
+  }
+  for (int i = 0; i < count; i++) {
+    uint32_t p = primes[i].p, r = k % p * primes[i].nmod % p;
+    if (k % p == 0) {
+      score += log(p) / p;
+    } else if (primes[i].residue[r / 64] >> (r % 64) & 1) {
+      score += 2 * log(p) / (p - 1);
+    }
+  }
+  return score;
+}
+
+/**
+ * @brief The best count square-free multipliers below CFRAC_MAX_MULT for
+ *   which kn is not a square, best first.
+ */
+static int choose_multipliers(const mpz_t n, unsigned long *k, int count) {
+  double score[CFRAC_MAX_MULT];
+  cfrac_score_prime_t primes[CFRAC_SCORE_LIMIT / 2];
+  int num_primes = 0, chosen = 0;
+  mpz_t kn;
+  mpz_init(kn);
+
+  for (uint32_t p = 3; p < CFRAC_SCORE_LIMIT; p += 2) {
+    if (!is_small_prime(p)) {
+      continue;
+    }
+    cfrac_score_prime_t *sp = &primes[num_primes++];
+    memset(sp, 0, sizeof(*sp));
+    sp->p = p;
+    sp->nmod = mpz_fdiv_ui(n, p);
+    for (uint32_t x = 1; x <= p / 2; x++) {
+      uint32_t r = x * x % p;
+      sp->residue[r / 64] |= 1ULL << (r % 64);
+    }
+  }
+
+  for (unsigned long m = 1; m < CFRAC_MAX_MULT; m++) {
+    int square_free = 1;
+    for (unsigned long d = 2; d * d <= m; d++) {
+      square_free &= m % (d * d) != 0;
+    }
+    mpz_mul_ui(kn, n, m);
+    if (!square_free || mpz_perfect_square_p(kn)) {
+      continue;
+    }
+
+    // insertion into the sorted best list
+    double s = multiplier_score(mpz_fdiv_ui(n, 8), primes, num_primes, m);
+    int pos = chosen < count ? chosen++ : count;
+    while (pos > 0 && score[pos - 1] < s) {
+      if (pos < count) {
+        score[pos] = score[pos - 1];
+        k[pos] = k[pos - 1];
+      }
+      pos--;
+    }
+    if (pos < count) {
+      score[pos] = s;
+      k[pos] = m;
+    }
+  }
+
+  mpz_clear(kn);
+  return chosen;
+}
+
+/**
+ * @brief Primes 2 .. up to size columns that can divide Q for one of
+ *   the multipliers.  Sets p to a factor if one of them divides n.
+ */
+static int build_factor_base(cfrac_t *cf, const unsigned long *k, int num_k, int size, mpz_t p) {
+  mpz_t kn;
+  mpz_init(kn);
+  cf->fb = calloc(size + 1, sizeof(cfrac_prime_t));
+  cf->columns = 1;
+
+  for (uint32_t q = 2; cf->columns <= size; q++) {
+    if (!is_small_prime(q)) {
+      continue;
+    }
+    if (mpz_divisible_ui_p(cf->n, q)) {
+      mpz_set_ui(p, q);
+      mpz_clear(kn);
+      return 0;
+    }
+
+    int useful = q == 2;
+    for (int t = 0; t < num_k && !useful; t++) {
+      mpz_mul_ui(kn, cf->n, k[t]);
+      useful = k[t] % q == 0 || mpz_kronecker_ui(kn, q) == 1;
+    }
+    if (!useful) {
+      continue;
+    }
+
+    cfrac_prime_t *fp = &cf->fb[cf->columns++];
+    fp->p = q;
+    if (q > 2) {
+      // Newton iteration, each step doubles the number of correct bits
+      uint64_t x = q;
+      for (int i = 0; i < 5; i++) {
+        x *= 2 - q * x;
+      }
+      fp->inv = x;
+      fp->limit = UINT64_MAX / q;
+      fp->inv128 = (u128)x * (2 - (u128)q * x);
+    }
+  }
+
+  cf->large_max = (uint64_t)cf->fb[cf->columns - 1].p * CFRAC_LP_MULT;
+  mpz_clear(kn);
+  return 1;
+}
+
+static void worker_init(cfrac_worker_t *w, cfrac_t *cf, unsigned long k) {
+  mpz_t kn, g;
+  mpz_inits(kn, g, NULL);
+
+  w->cf = cf;
+  w->k = k;
+  w->primes = malloc(cf->columns * sizeof(uint32_t));
+  w->num_primes = 0;
+  mpz_mul_ui(kn, cf->n, k);
+  for (int j = 1; j < cf->columns; j++) {
+    uint32_t q = cf->fb[j].p;
+    if (q == 2 || k % q == 0 || mpz_kronecker_ui(kn, q) == 1) {
+      w->primes[w->num_primes++] = j;
+    }
+  }
+
+  // Q is about sqrt(kn), the early abort wants it well down by stage 2
+  w->abort_bits = (int)(mpz_sizeinbase(kn, 2) / 2 * CFRAC_ABORT_KEEP);
+
+  // i = 1: P = g, Q_1 = kn - g^2, Q_0 = 1, A_0 = g, A_-1 = 1
+  mpz_sqrt(g, kn);
+  w->g = mpz_get_u128(g);
+  w->P = w->g;
+  mpz_submul(kn, g, g);
+  w->Q = mpz_get_u128(kn);
+  w->Qprev = 1;
+  mpz_init(w->a);
+  mpz_init_set_ui(w->aprev, 1);
+  mpz_mod(w->a, g, cf->n);
+  w->i = 1;
+  w->done = 0;
+
+  mpz_clears(kn, g, NULL);
+}
+
+static void rel_set(cfrac_rel_t *r, const mpz_t a, const uint32_t *factors, int count, uint64_t large) {
+  mpz_init_set(r->a, a);
+  r->factors = malloc(count * sizeof(uint32_t));
+  memcpy(r->factors, factors, count * sizeof(uint32_t));
+  r->count = count;
+  r->large = large;
+}
+
+static void rel_clear(cfrac_rel_t *r) {
+  mpz_clear(r->a);
+  free(r->factors);
+}
+
+/**
+ * @brief Add a full relation, or a partial one; a partial whose large
+ *   prime was seen before is merged with the earlier one.  Caller holds
+ *   the lock.
+ */
+static void add_relation(cfrac_t *cf, const mpz_t a, const uint32_t *factors, int count, uint64_t large) {
+  if (large > 1) {
+    int *bucket = &cf->buckets[large % CFRAC_BUCKETS];
+    int i = *bucket;
+    while (i >= 0 && cf->partials[i].large != large) {
+      i = cf->partials[i].next;
+    }
+
+    if (i < 0) {
+      if (cf->num_partials == cf->cap_partials) {
+        cf->cap_partials = cf->cap_partials ? 2 * cf->cap_partials : 1024;
+        cf->partials = realloc(cf->partials, cf->cap_partials * sizeof(cfrac_rel_t));
+      }
+      cfrac_rel_t *r = &cf->partials[cf->num_partials];
+      rel_set(r, a, factors, count, large);
+      r->next = *bucket;
+      *bucket = cf->num_partials++;
+      return;
+    }
+
+    // (a a')^2 = Q Q' with large^2 in it
+    const cfrac_rel_t *other = &cf->partials[i];
+    uint32_t merged[2 * CFRAC_MAX_FACTORS];
+    mpz_t aa;
+    mpz_init(aa);
+    mpz_mul(aa, a, other->a);
+    mpz_mod(aa, aa, cf->n);
+    memcpy(merged, factors, count * sizeof(uint32_t));
+    memcpy(merged + count, other->factors, other->count * sizeof(uint32_t));
+    add_relation(cf, aa, merged, count + other->count, 1);
+    cf->rels[cf->num_rels - 1].large = large;
+    mpz_clear(aa);
+    return;
+  }
+
+  if (cf->num_rels == cf->cap_rels) {
+    cf->cap_rels = cf->cap_rels ? 2 * cf->cap_rels : 1024;
+    cf->rels = realloc(cf->rels, cf->cap_rels * sizeof(cfrac_rel_t));
+  }
+  rel_set(&cf->rels[cf->num_rels++], a, factors, count, 1);
+  if (cf->num_rels >= cf->target) {
+    cf->stop = 1;
+  }
+}
+
+/**
+ * @brief Trial divide Q_i for the relation A_{i-1}^2 = (-1)^i Q_i.
+ */
+static void check_relation(cfrac_worker_t *w) {
+  cfrac_t *cf = w->cf;
+  uint32_t factors[CFRAC_MAX_FACTORS];
+  int count = 0;
+  u128 q = w->Q;
+
+  if (w->i & 1) {
+    factors[count++] = 0;
+  }
+
+  int twos = (uint64_t)q ? __builtin_ctzll((uint64_t)q) : 64 + __builtin_ctzll((uint64_t)(q >> 64));
+  q >>= twos;
+  for (int t = 0; t < twos; t++) {
+    factors[count++] = 1;
+  }
+
+  // primes[0] is 2, done above
+  for (int j = 1; j < w->num_primes; j++) {
+    if (j == CFRAC_STAGE1_PRIMES && u128_bits(q) > w->abort_bits) {
+      return;
+    }
+    const cfrac_prime_t *fp = &cf->fb[w->primes[j]];
+    while (divides(fp, q)) {
+      q *= fp->inv128;
+      factors[count++] = w->primes[j];
+    }
+  }
+
+  if (q != 1 && q > cf->large_max) {
+    return;
+  }
+
+  pthread_mutex_lock(&cf->lock);
+  add_relation(cf, w->a, factors, count, (uint64_t)q);
+  pthread_mutex_unlock(&cf->lock);
+}
+
+/**
+ * @brief One step of the expansion: check Q_i, then move to i + 1.
+ */
+static void worker_step(cfrac_worker_t *w) {
+  check_relation(w);
+
+  // a_i = floor((g + P_i) / Q_i), nearly always small
+  u128 t = w->g + w->P, a = 1;
+  if (t >= w->Q << 3) {
+    a = t / w->Q;
+  } else {
+    for (t -= w->Q; t >= w->Q; t -= w->Q) {
+      a++;
+    }
+  }
+
+  // P_{i+1} = a_i Q_i - P_i, Q_{i+1} = Q_{i-1} + a_i (P_i - P_{i+1})
+  u128 P = a * w->Q - w->P;
+  u128 Q = (u128)((s128)w->Qprev + (s128)a * ((s128)w->P - (s128)P));
+  w->P = P;
+  w->Qprev = w->Q;
+  w->Q = Q;
+
+  // A_i = a_i A_{i-1} + A_{i-2} mod n
+  if (a <= ~0UL) {
+    mpz_addmul_ui(w->aprev, w->a, (unsigned long)a);
+  } else {
+    mpz_t big;
+    mpz_init(big);
+    mpz_set_u128(big, a);
+    mpz_addmul(w->aprev, w->a, big);
+    mpz_clear(big);
+  }
+  mpz_mod(w->aprev, w->aprev, w->cf->n);
+  mpz_swap(w->a, w->aprev);
+  w->i++;
+
+  // Q = 1 at an even step closes the period
+  w->done = Q == 1 && !(w->i & 1);
+}
+
+/**
+ * @brief Method each thread follows: step its expansion until the pool
+ *   has enough relations or n was factored elsewhere.
+ */
+static void *cfrac_worker(void *input) {
+  cfrac_worker_t *w = (cfrac_worker_t *)input;
+  cfrac_t *cf = w->cf;
+  uint64_t steps = 0;
+
+  place_pin(cf->placement, w->id);
+  while (!w->done && !__atomic_load_n(&cf->stop, __ATOMIC_RELAXED) &&
+         !(cf->found && __atomic_load_n(cf->found, __ATOMIC_ACQUIRE))) {
+    for (int s = 0; s < CFRAC_CHECK_STEPS && !w->done; s++) {
+      worker_step(w);
+    }
+    steps += CFRAC_CHECK_STEPS;
+  }
+
+  __atomic_add_fetch(&cf->steps, steps, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+/**
+ * @brief Find subsets of the relations whose Q multiply to a square and
+ *   try each on n.
+ *
+ * @return 1 with a nontrivial factor in p.
+ */
+static int cfrac_solve(cfrac_t *cf, mpz_t p) {
+  int rows = cf->num_rels, cols = cf->columns;
+  int cw = (cols + 63) / 64, hw = (rows + 63) / 64, width = cw + hw;
+  uint64_t *m = calloc((size_t)rows * width, sizeof(uint64_t));
+  char *pivot = calloc(rows, 1);
+
+  // exponent parities, then the identity to track row combinations
+  for (int r = 0; r < rows; r++) {
+    uint64_t *row = m + (size_t)r * width;
+    for (int f = 0; f < cf->rels[r].count; f++) {
+      uint32_t c = cf->rels[r].factors[f];
+      row[c / 64] ^= 1ULL << (c % 64);
+    }
+    row[cw + r / 64] |= 1ULL << (r % 64);
+  }
+
+  for (int c = 0; c < cols; c++) {
+    int w0 = c / 64;
+    uint64_t bit = 1ULL << (c % 64);
+    int r = 0;
+    while (r < rows && (pivot[r] || !(m[(size_t)r * width + w0] & bit))) {
+      r++;
+    }
+    if (r == rows) {
+      continue;
+    }
+    pivot[r] = 1;
+
+    // columns left of c are already clear in every other row
+    const uint64_t *src = m + (size_t)r * width;
+    for (int s = 0; s < rows; s++) {
+      uint64_t *dst = m + (size_t)s * width;
+      if (s != r && (dst[w0] & bit)) {
+        for (int j = w0; j < width; j++) {
+          dst[j] ^= src[j];
+        }
+      }
+    }
+  }
+
+  // every row that was never a pivot is now zero: a dependency
+  int found = 0;
+  int *exponent = malloc(cols * sizeof(int));
+  mpz_t x, y, t;
+  mpz_inits(x, y, t, NULL);
+
+  for (int d = 0; d < rows && !found; d++) {
+    if (pivot[d]) {
+      continue;
+    }
+    const uint64_t *history = m + (size_t)d * width + cw;
+    memset(exponent, 0, cols * sizeof(int));
+    mpz_set_ui(x, 1);
+    mpz_set_ui(y, 1);
+
+    for (int r = 0; r < rows; r++) {
+      if (!(history[r / 64] >> (r % 64) & 1)) {
+        continue;
+      }
+      const cfrac_rel_t *rel = &cf->rels[r];
+      mpz_mul(x, x, rel->a);
+      mpz_mod(x, x, cf->n);
+      mpz_mul_ui(y, y, rel->large);
+      mpz_mod(y, y, cf->n);
+      for (int f = 0; f < rel->count; f++) {
+        exponent[rel->factors[f]]++;
+      }
+    }
+
+    // y = sqrt of the product of the Q
+    for (int c = 1; c < cols; c++) {
+      mpz_ui_pow_ui(t, cf->fb[c].p, exponent[c] / 2);
+      mpz_mul(y, y, t);
+      mpz_mod(y, y, cf->n);
+    }
+
+    mpz_sub(t, x, y);
+    mpz_gcd(p, t, cf->n);
+    found = mpz_cmp_ui(p, 1) != 0 && mpz_cmp(p, cf->n) != 0;
+  }
+
+  mpz_clears(x, y, t, NULL);
+  free(exponent);
+  free(pivot);
+  free(m);
+  return found;
+}
+
+/**
+ * @brief Factor n with the continued fraction method, on
+ *   tune_profile.threads threads placed as the profile says.
+ *
+ * @param n odd composite to factor, at most CFRAC_MAX_BITS bits.
+ * @param thread_struct p is set to a nontrivial factor (0 if n is too
+ *   large or another thread set *found first), *found is set.
+ */
+void cfrac(mpz_t n, rsa_decrypt_t *thread_struct) {
+  cfrac_threads(n, thread_struct, tune_profile.threads, place_policy(tune_profile.placement));
+}
+
+/**
+ * @brief cfrac on a given number of threads, pinned under placement
+ *   (PLACE_NONE to leave them to the kernel), for callers that run
+ *   their own threads.
+ */
+void cfrac_threads(mpz_t n, rsa_decrypt_t *thread_struct, int threads, int placement) {
+  unsigned long k[TUNE_MAX_THREADS];
+  cfrac_t cf = {0};
+
+  mpz_set_ui(thread_struct->p, 0);
+  if (mpz_sizeinbase(n, 2) > CFRAC_MAX_BITS) {
+    return;
+  }
+  if (mpz_even_p(n)) {
+    mpz_set_ui(thread_struct->p, 2);
+    __atomic_store_n(thread_struct->found, 1, __ATOMIC_RELEASE);
+    return;
+  }
+  if (mpz_perfect_square_p(n)) {
+    mpz_sqrt(thread_struct->p, n);
+    __atomic_store_n(thread_struct->found, 1, __ATOMIC_RELEASE);
+    return;
+  }
+
+  cf.n = n;
+  cf.found = thread_struct->found;
+  cf.placement = placement;
+  if (threads > TUNE_MAX_THREADS) threads = TUNE_MAX_THREADS;
+  threads = choose_multipliers(n, k, threads < 1 ? 1 : threads);
+
+  double ln = mpz_sizeinbase(n, 2) * log(2);
+  int size = (int)exp(CFRAC_FB_SCALE * sqrt(ln * log(ln)));
+  if (!build_factor_base(&cf, k, threads, size < CFRAC_FB_MIN ? CFRAC_FB_MIN : size, thread_struct->p)) {
+    __atomic_store_n(thread_struct->found, 1, __ATOMIC_RELEASE);
+    free(cf.fb);
+    return;
+  }
+
+  cf.buckets = malloc(CFRAC_BUCKETS * sizeof(int));
+  memset(cf.buckets, -1, CFRAC_BUCKETS * sizeof(int));
+  pthread_mutex_init(&cf.lock, NULL);
+
+  cfrac_worker_t *workers = calloc(threads, sizeof(cfrac_worker_t));
+  pthread_t thread_ids[TUNE_MAX_THREADS];
+  for (int t = 0; t < threads; t++) {
+    worker_init(&workers[t], &cf, k[t]);
+    workers[t].id = t;
+  }
+
+  // collect, solve, and collect a few more if every dependency was trivial
+  cf.target = cf.columns + CFRAC_EXTRA;
+  int solved = 0, running = threads;
+  while (!solved && running && !__atomic_load_n(thread_struct->found, __ATOMIC_ACQUIRE)) {
+    cf.stop = 0;
+    for (int t = 0; t < threads; t++) {
+      pthread_create(&thread_ids[t], NULL, cfrac_worker, &workers[t]);
+    }
+    running = 0;
+    for (int t = 0; t < threads; t++) {
+      pthread_join(thread_ids[t], NULL);
+      running += !workers[t].done;
+    }
+    if (cf.num_rels >= cf.target) {
+      solved = cfrac_solve(&cf, thread_struct->p);
+      cf.target = cf.num_rels + CFRAC_EXTRA;
+    }
+  }
+
+  if (solved) {
+    __atomic_store_n(thread_struct->found, 1, __ATOMIC_RELEASE);
+  } else {
+    mpz_set_ui(thread_struct->p, 0);
+  }
+
+  for (int t = 0; t < threads; t++) {
+    free(workers[t].primes);
+    mpz_clears(workers[t].a, workers[t].aprev, NULL);
+  }
+  for (int r = 0; r < cf.num_rels; r++) {
+    rel_clear(&cf.rels[r]);
+  }
+  for (int r = 0; r < cf.num_partials; r++) {
+    rel_clear(&cf.partials[r]);
+  }
+  pthread_mutex_destroy(&cf.lock);
+  free(workers);
+  free(cf.rels);
+  free(cf.partials);
+  free(cf.buckets);
+  free(cf.fb);
+}
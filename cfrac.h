@@ -0,0 +1,26 @@
+/**
+ * @file cfrac.h
+ * @brief Header for cfrac.c, continued fraction (Morrison-Brillhart)
+ *   factoring for keys too large for Pollard Rho.
+ * @version 0.1
+ * @date 2021-05-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef _CFRAC_H
+#define _CFRAC_H
+
+#include <gmp.h>
+
+#include "rsa.h"
+
+#define CFRAC_MAX_BITS 200    // keeps 2 sqrt(kn) in 128 bits
+#define CFRAC_MAX_MULT 100    // multipliers k tried are below this
+#define CFRAC_EXTRA 32        // relations beyond the factor base size
+#define CFRAC_LP_MULT 64      // large primes up to this times the largest prime
+
+void cfrac(mpz_t n, rsa_decrypt_t *thread_struct);
+void cfrac_threads(mpz_t n, rsa_decrypt_t *thread_struct, int threads, int placement);
+
+#endif
@@ -0,0 +1,252 @@
+/**
+ * @file codebook.c
+ * @brief Codebook attack for small keys.  Encryption is deterministic
+ *   textbook RSA, and up to 64 bits a block is at most 4 bytes of
+ *   (mostly printable) text, so encrypting every plausible block under
+ *   (n, e) and matching the ciphertext can beat factoring n.  Trial
+ *   encryptions run MONT_LANES at a time on the montlane kernel.
+ * @version 0.1
+ * @date 2021-05-26
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "codebook.h"
+#include "montlane.h"
+#include "tune.h"
+
+#define PRINTABLE_FIRST 0x20
+#define PRINTABLE_LAST 0x7e
+#define NUM_PRINTABLE (PRINTABLE_LAST - PRINTABLE_FIRST + 1)
+
+// One ciphertext block we are looking for
+typedef struct {
+  uint64_t cipher;
+  uint32_t clear;   // plaintext block, once found
+  int used;
+  int found;
+} codebook_entry_t;
+
+typedef struct {
+  codebook_entry_t *slots; // open addressing, keyed by ciphertext
+  size_t mask;
+  int remaining;           // distinct ciphertexts not found yet
+
+  mpz_srcptr e;
+  mont_ctx_t ctx;
+  mont_vec_t x;
+  uint32_t clear[MONT_LANES];
+  int lanes;               // lanes filled in x
+} codebook_t;
+
+// Value of a len byte native-order word, the same as BLOCK_TO_MPZ
+static uint64_t word_value(const char *buf, int len) {
+  uint64_t v = 0;
+  for (int i = 0; i < len; i++) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = (v << 8) | (unsigned char)buf[i];
+#else
+    v |= (uint64_t)(unsigned char)buf[i] << (8 * i);
+#endif
+  }
+  return v;
+}
+
+static void word_bytes(uint64_t v, char *buf, int len) {
+  for (int i = 0; i < len; i++) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    buf[len - 1 - i] = (char)(v >> (8 * i));
+#else
+    buf[i] = (char)(v >> (8 * i));
+#endif
+  }
+}
+
+static codebook_entry_t *table_slot(codebook_t *cb, uint64_t cipher) {
+  size_t i = (cipher * 0x9e3779b97f4a7c15ULL) >> 32 & cb->mask;
+  while (cb->slots[i].used && cb->slots[i].cipher != cipher) {
+    i = (i + 1) & cb->mask;
+  }
+  return &cb->slots[i];
+}
+
+// Encrypt the filled lanes and record any ciphertext we are after
+static void codebook_flush(codebook_t *cb) {
+  mont_vec_t y;
+
+  mont_enter(&cb->ctx, cb->x, cb->x);
+  mont_powm(&cb->ctx, y, cb->x, cb->e);
+  mont_redc(&cb->ctx, y, y);
+
+  for (int lane = 0; lane < cb->lanes; lane++) {
+    uint64_t cipher = y[0][lane];
+    if (cb->ctx.limbs > 1) {
+      cipher |= y[1][lane] << 32;
+    }
+
+    codebook_entry_t *entry = table_slot(cb, cipher);
+    if (entry->used && !entry->found) {
+      entry->found = 1;
+      entry->clear = cb->clear[lane];
+      cb->remaining--;
+    }
+  }
+  cb->lanes = 0;
+}
+
+static void codebook_try(codebook_t *cb, uint32_t clear) {
+  cb->clear[cb->lanes] = clear;
+  cb->x[0][cb->lanes] = clear;
+  for (int j = 1; j < cb->ctx.limbs; j++) {
+    cb->x[j][cb->lanes] = 0;
+  }
+  if (++cb->lanes == MONT_LANES) {
+    codebook_flush(cb);
+  }
+}
+
+// Every block of `printable` printable bytes followed by zero bytes
+// (the end of the message and the zero padding of the last block).
+static void codebook_enumerate(codebook_t *cb, int block_size, int printable) {
+  int digit[4] = {0};
+  char bytes[4] = {0};
+
+  for (;;) {
+    for (int i = 0; i < printable; i++) {
+      bytes[i] = PRINTABLE_FIRST + digit[i];
+    }
+    codebook_try(cb, word_value(bytes, block_size));
+
+    // odometer over the printable positions
+    int i = 0;
+    while (i < printable && ++digit[i] == NUM_PRINTABLE) {
+      digit[i++] = 0;
+    }
+    if (i == printable) {
+      return;
+    }
+    if (cb->lanes == 0 && cb->remaining == 0) {
+      return;
+    }
+  }
+}
+
+/**
+ * @brief Estimated time to decrypt by enumerating the printable blocks.
+ */
+double codebook_predicted_usec(rsa_keys_t *keys) {
+  if (keys->num_bits > CODEBOOK_MAX_BITS || keys->enc_block_size == 0) {
+    return INFINITY;
+  }
+
+  double candidates = 0;
+  for (unsigned int m = 0; m <= keys->enc_block_size; m++) {
+    candidates += pow(NUM_PRINTABLE, m);
+  }
+  return candidates * tune_profile.codebook_ns_per_candidate / 1000;
+}
+
+/**
+ * @brief Estimated time to factor n with the engine find-key would use.
+ */
+double rho_predicted_usec(rsa_keys_t *keys) {
+  if (tune_use_cfrac(&tune_profile, keys->num_bits)) {
+    return tune_cfrac_units(keys->num_bits) * tune_profile.cfrac_ns_per_unit / 1000;
+  }
+  double ns = tune_use_rho_batch(&tune_profile, keys->num_bits) ?
+    tune_profile.batch_ns_per_iteration : tune_profile.rho_ns_per_iteration;
+  return tune_rho_iterations(keys->num_bits) * ns / 1000;
+}
+
+/**
+ * @brief Whether the codebook should be tried before factoring this key.
+ */
+int codebook_predicted_faster(rsa_keys_t *keys) {
+  return codebook_predicted_usec(keys) < rho_predicted_usec(keys);
+}
+
+/**
+ * @brief Decrypt a message without the private key by building a
+ *   ciphertext to plaintext table for its blocks.
+ *
+ * @param keys public key (n and e) the message was encrypted with.
+ * @param encrypted the encrypted message.
+ * @param bytes length of the encrypted message.
+ * @param decrypted buffer for the clear text, like rsa_decrypt's.
+ * @return number of decrypted bytes, or -1 if some block is not
+ *   printable text and the key has to be factored after all.
+ */
+int codebook_decrypt(rsa_keys_t *keys, const char *encrypted, int bytes, char *decrypted) {
+  int in_block_size = keys->dec_block_size;
+  int out_block_size = keys->enc_block_size;
+  int nblocks = bytes / in_block_size;
+
+  if (keys->num_bits > CODEBOOK_MAX_BITS || out_block_size == 0 ||
+      out_block_size > 4 || mont_limbs_for(keys->n) == 0) {
+    return -1;
+  }
+
+  codebook_t *cb = calloc(1, sizeof(codebook_t));
+  size_t size = 16;
+  while (size < 2 * (size_t)nblocks) {
+    size *= 2;
+  }
+  cb->slots = calloc(size, sizeof(codebook_entry_t));
+  cb->mask = size - 1;
+  cb->e = keys->e;
+
+  mont_ctx_init(&cb->ctx, mont_limbs_for(keys->n));
+  for (int lane = 0; lane < MONT_LANES; lane++) {
+    mont_set_modulus(&cb->ctx, lane, keys->n);
+  }
+
+  for (int b = 0; b < nblocks; b++) {
+    codebook_entry_t *entry = table_slot(cb, word_value(encrypted + b * in_block_size, in_block_size));
+    if (!entry->used) {
+      entry->used = 1;
+      entry->cipher = word_value(encrypted + b * in_block_size, in_block_size);
+      cb->remaining++;
+    }
+  }
+
+  // the blocks covering the known prefix go first
+  const char *prefix = CODEBOOK_PREFIX;
+  for (int pos = 0; pos + out_block_size <= (int)strlen(prefix); pos += out_block_size) {
+    codebook_try(cb, word_value(prefix + pos, out_block_size));
+  }
+
+  // then printable text, longest runs first since most blocks are full
+  for (int printable = out_block_size; printable >= 0 && cb->remaining; printable--) {
+    codebook_enumerate(cb, out_block_size, printable);
+  }
+  if (cb->lanes) {
+    codebook_flush(cb);
+  }
+
+  // short blocks can afford the whole space for any stray byte
+  if (cb->remaining && out_block_size <= 2) {
+    for (uint32_t clear = 0; clear < (1u << (8 * out_block_size)); clear++) {
+      codebook_try(cb, clear);
+    }
+  }
+  if (cb->lanes) {
+    codebook_flush(cb);
+  }
+
+  int result = -1;
+  if (cb->remaining == 0) {
+    for (int b = 0; b < nblocks; b++) {
+      codebook_entry_t *entry = table_slot(cb, word_value(encrypted + b * in_block_size, in_block_size));
+      word_bytes(entry->clear, decrypted + b * out_block_size, out_block_size);
+    }
+    result = nblocks * out_block_size;
+  }
+
+  free(cb->slots);
+  free(cb);
+  return result;
+}
@@ -0,0 +1,24 @@
+/**
+ * @file codebook.h
+ * @brief Header for codebook.c, decrypting small-block messages by
+ *   encrypting every plausible plaintext block instead of factoring.
+ * @version 0.1
+ * @date 2021-05-26
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef _CODEBOOK_H
+#define _CODEBOOK_H
+
+#include "rsa.h"
+
+#define CODEBOOK_MAX_BITS 64          // n must fit in a machine word
+#define CODEBOOK_PREFIX "<h1>"        // make-test wraps every message in this
+
+double codebook_predicted_usec(rsa_keys_t *keys);
+double rho_predicted_usec(rsa_keys_t *keys);
+int codebook_predicted_faster(rsa_keys_t *keys);
+int codebook_decrypt(rsa_keys_t *keys, const char *encrypted, int bytes, char *decrypted);
+
+#endif
@@ -0,0 +1,432 @@
+/**
+ * @file crack.c
+ * @brief Asynchronous key cracking for programs that link the engines
+ *   instead of running find-key.  crack_submit queues a public key (and
+ *   optionally its ciphertext) on a pool of worker threads and returns a
+ *   handle at once; the handle is polled, waited on with a timeout or
+ *   cancelled, and an optional callback runs when the job finishes.
+ *
+ *   A worker tries the engines in find-key's order, skipping the ones
+ *   that cannot be stopped: the Fermat pass (bounded by fermat_budget),
+ *   cfrac past cfrac_min_bits (one unpinned thread per job, the pool is
+ *   the parallelism), then pollardRho.  Cancelling sets the flag cfrac
+ *   and pollardRho watch as found, and the job's GMP state is freed as
+ *   soon as the engine returns.  rho_batch has no such flag, so keys
+ *   below the cfrac crossover go to pollardRho.
+ *
+ *   At most max_jobs jobs exist at once, queued, running or finished but
+ *   not yet released; crack_submit blocks until one is freed.
+ * @version 0.1
+ * @date 2021-06-04
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "crack.h"
+#include "primefact.h"
+#include "fermat.h"
+#include "cfrac.h"
+#include "tune.h"
+#include "place.h"
+
+struct crack_job {
+  crack_pool_t *pool;
+  crack_job_t *next;         // in the queue
+  crack_job_t *prev_all;     // every job of the pool, for crack_pool_destroy
+  crack_job_t *next_all;
+  int refs;                  // the caller's handle and the pool's
+  int stop;                  // the engines' found flag, set to cancel
+  crack_result_t result;
+  mpz_t n, e;                // cleared once the job finishes
+  char *encrypted;           // NULL without a ciphertext
+  int enc_len;
+  crack_callback_t callback;
+  void *arg;
+  pthread_cond_t finished;
+  struct timespec submitted;
+};
+
+struct crack_pool {
+  pthread_mutex_t lock;
+  pthread_cond_t work;       // a job was queued, or shutdown
+  pthread_cond_t room;       // a job was freed
+  crack_job_t *head, *tail;  // queued jobs, oldest first
+  crack_job_t *all;
+  int jobs;                  // jobs not yet freed
+  int max_jobs;
+  int shutdown;
+  int threads;
+  pthread_t thread_ids[CRACK_MAX_THREADS];
+};
+
+static uint64_t usec_since(const struct timespec *tick) {
+  struct timespec tock;
+  clock_gettime(CLOCK_MONOTONIC, &tock);
+  return (tock.tv_sec - tick->tv_sec) * 1000000 + (tock.tv_nsec - tick->tv_nsec) / 1000;
+}
+
+/**
+ * @brief Free a job once neither the caller nor the pool holds it.
+ *   Called with the lock held.
+ */
+static void job_unref(crack_job_t *job) {
+  crack_pool_t *pool = job->pool;
+  if (--job->refs > 0) {
+    return;
+  }
+  if (job->prev_all) job->prev_all->next_all = job->next_all;
+  else pool->all = job->next_all;
+  if (job->next_all) job->next_all->prev_all = job->prev_all;
+
+  if (job->result.status == CRACK_DONE) {
+    mpz_clears(job->result.keys.p, job->result.keys.q, job->result.keys.n, job->result.keys.d,
+               job->result.keys.e, NULL);
+  }
+  free(job->result.message);
+  pthread_cond_destroy(&job->finished);
+  free(job);
+  pool->jobs--;
+  pthread_cond_signal(&pool->room);
+}
+
+/**
+ * @brief Settle a job: free its inputs, publish the status, run the
+ *   callback and drop the pool's reference.  Called without the lock.
+ */
+static void job_finish(crack_job_t *job, int status) {
+  crack_pool_t *pool = job->pool;
+
+  mpz_clears(job->n, job->e, NULL);
+  free(job->encrypted);
+  job->encrypted = NULL;
+  job->result.usec = usec_since(&job->submitted);
+  __atomic_store_n(&job->result.status, status, __ATOMIC_RELEASE);
+
+  if (job->callback != NULL) {
+    job->callback(job, job->arg);
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pthread_cond_broadcast(&job->finished);
+  job_unref(job);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Factor the job's key and decrypt its ciphertext.
+ *
+ * @return the job's final status.
+ */
+static int job_run(crack_job_t *job) {
+  crack_result_t *r = &job->result;
+  rsa_keys_t *keys = &r->keys;
+
+  if (mpz_cmp_ui(job->n, 3) <= 0 || mpz_probab_prime_p(job->n, 25)) {
+    return CRACK_FAILED;
+  }
+
+  mpz_inits(keys->p, keys->q, keys->d, NULL);
+  mpz_init_set(keys->n, job->n);
+  mpz_init_set(keys->e, job->e);
+
+  rsa_decrypt_t thread_struct = {0};
+  thread_struct.keys = keys;
+  thread_struct.found = &job->stop;
+  mpz_init(thread_struct.p);
+
+  int found = 0;
+  if (tune_profile.fermat_budget > 0) {
+    found = fermat(job->n, thread_struct.p, tune_profile.fermat_budget, NULL);
+  }
+  if (!found && !__atomic_load_n(&job->stop, __ATOMIC_ACQUIRE) &&
+      tune_use_cfrac(&tune_profile, mpz_sizeinbase(job->n, 2))) {
+    // sets p to 0 when it gives up or is stopped
+    cfrac_threads(job->n, &thread_struct, 1, PLACE_NONE);
+    found = mpz_cmp_ui(thread_struct.p, 1) > 0 && mpz_cmp(thread_struct.p, job->n) < 0;
+  }
+  if (!found && !__atomic_load_n(&job->stop, __ATOMIC_ACQUIRE)) {
+    found = pollardRho(job->n, &thread_struct);
+  }
+
+  if (!found) {
+    mpz_clears(thread_struct.p, keys->p, keys->q, keys->n, keys->d, keys->e, NULL);
+    return CRACK_CANCELLED;
+  }
+
+  // p < q, and d = e^-1 mod (p - 1)(q - 1) as find-key's compute_private_key
+  mpz_divexact(keys->q, job->n, thread_struct.p);
+  if (mpz_cmp(thread_struct.p, keys->q) < 0) {
+    mpz_set(keys->p, thread_struct.p);
+  } else {
+    mpz_set(keys->p, keys->q);
+    mpz_set(keys->q, thread_struct.p);
+  }
+  mpz_sub_ui(thread_struct.p, keys->p, 1);
+  mpz_sub_ui(keys->d, keys->q, 1);
+  mpz_mul(thread_struct.p, thread_struct.p, keys->d);
+  if (!mpz_invert(keys->d, keys->e, thread_struct.p)) {
+    mpz_set_ui(keys->d, 0);
+  }
+  mpz_clear(thread_struct.p);
+
+  if (job->encrypted != NULL) {
+    // crack_submit took whole blocks only.  A block that does not decrypt
+    // below 256^enc_block_size (a wrong key or a corrupt ciphertext) is
+    // exported as up to dec_block_size + enc_block_size - 1 bytes, so
+    // the last one gets that much room.
+    int blocks = job->enc_len / keys->dec_block_size;
+    r->message = malloc((size_t)blocks * keys->enc_block_size + keys->dec_block_size + 1);
+    r->message_len = rsa_decrypt(job->encrypted, r->message, job->enc_len, keys);
+    r->message[r->message_len] = 0;
+  }
+  return CRACK_DONE;
+}
+
+/**
+ * @brief Method each pool thread follows: run queued jobs until the pool
+ *   shuts down.
+ */
+static void *crack_worker(void *input) {
+  crack_pool_t *pool = (crack_pool_t *)input;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (pool->head == NULL && !pool->shutdown) {
+      pthread_cond_wait(&pool->work, &pool->lock);
+    }
+    if (pool->head == NULL) {
+      break;
+    }
+    crack_job_t *job = pool->head;
+    pool->head = job->next;
+    if (pool->head == NULL) pool->tail = NULL;
+    job->result.status = CRACK_RUNNING;
+    pthread_mutex_unlock(&pool->lock);
+
+    job_finish(job, job_run(job));
+    pthread_mutex_lock(&pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/**
+ * @brief Start a pool.
+ *
+ * @param threads jobs run at once.
+ * @param max_jobs jobs that may exist at once, the bound on memory.
+ */
+crack_pool_t *crack_pool_create(int threads, int max_jobs) {
+  if (threads < 1) threads = 1;
+  if (threads > CRACK_MAX_THREADS) threads = CRACK_MAX_THREADS;
+  if (max_jobs < threads) max_jobs = threads;
+
+  crack_pool_t *pool = calloc(1, sizeof(crack_pool_t));
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->room, NULL);
+  pool->max_jobs = max_jobs;
+  pool->threads = threads;
+  for (int t = 0; t < threads; t++) {
+    pthread_create(&pool->thread_ids[t], NULL, crack_worker, pool);
+  }
+  return pool;
+}
+
+/**
+ * @brief Queue a key.  Blocks while max_jobs jobs exist.
+ *
+ * @param public_keys n, e and the block sizes are copied.
+ * @param encrypted ciphertext to decrypt once factored, may be NULL.
+ * @param enc_len its length, a whole number of dec_block_size blocks.
+ * @param callback run when the job finishes, may be NULL.
+ * @return a handle, to be given back with crack_release, or NULL if the
+ *   ciphertext is not whole blocks of the key.
+ */
+crack_job_t *crack_submit(crack_pool_t *pool, const rsa_keys_t *public_keys, const char *encrypted,
+                          int enc_len, crack_callback_t callback, void *arg) {
+  if (encrypted != NULL && enc_len != 0 &&
+      (enc_len < 0 || public_keys->dec_block_size == 0 || public_keys->enc_block_size == 0 ||
+       enc_len % public_keys->dec_block_size != 0)) {
+    return NULL;
+  }
+
+  crack_job_t *job = calloc(1, sizeof(crack_job_t));
+  job->pool = pool;
+  job->refs = 2;
+  job->callback = callback;
+  job->arg = arg;
+  mpz_init_set(job->n, public_keys->n);
+  mpz_init_set(job->e, public_keys->e);
+  job->result.keys.num_bits = public_keys->num_bits;
+  job->result.keys.enc_block_size = public_keys->enc_block_size;
+  job->result.keys.dec_block_size = public_keys->dec_block_size;
+  if (encrypted != NULL && enc_len > 0) {
+    job->encrypted = malloc(enc_len);
+    memcpy(job->encrypted, encrypted, enc_len);
+    job->enc_len = enc_len;
+  }
+
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&job->finished, &attr);
+  pthread_condattr_destroy(&attr);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->jobs >= pool->max_jobs) {
+    pthread_cond_wait(&pool->room, &pool->lock);
+  }
+  pool->jobs++;
+  job->next_all = pool->all;
+  if (pool->all) pool->all->prev_all = job;
+  pool->all = job;
+
+  clock_gettime(CLOCK_MONOTONIC, &job->submitted);
+  job->result.status = CRACK_PENDING;
+  if (pool->tail) pool->tail->next = job;
+  else pool->head = job;
+  pool->tail = job;
+  pthread_cond_signal(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+  return job;
+}
+
+/**
+ * @brief The job's status, without blocking.
+ */
+int crack_poll(crack_job_t *job) {
+  return __atomic_load_n(&job->result.status, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Wait for the job to finish.
+ *
+ * @param timeout_usec longest wait, negative for no limit.
+ * @return the job's status, CRACK_PENDING or CRACK_RUNNING on timeout.
+ */
+int crack_wait(crack_job_t *job, int64_t timeout_usec) {
+  crack_pool_t *pool = job->pool;
+  struct timespec deadline;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  if (timeout_usec >= 0) {
+    deadline.tv_sec += timeout_usec / 1000000;
+    deadline.tv_nsec += (timeout_usec % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  while (job->result.status <= CRACK_RUNNING || job->refs > 1) {
+    // finished but still in its callback: the pool's reference is dropped last
+    if (timeout_usec < 0) {
+      pthread_cond_wait(&job->finished, &pool->lock);
+    } else if (pthread_cond_timedwait(&job->finished, &pool->lock, &deadline) == ETIMEDOUT) {
+      break;
+    }
+  }
+  int status = job->result.status;
+  pthread_mutex_unlock(&pool->lock);
+  return status;
+}
+
+/**
+ * @brief Stop a job.  A queued job is cancelled at once; a running one
+ *   stops at its engine's next check, or may still finish CRACK_DONE.
+ *
+ * @return 1 if the job had not finished, 0 if it had.
+ */
+int crack_cancel(crack_job_t *job) {
+  crack_pool_t *pool = job->pool;
+
+  pthread_mutex_lock(&pool->lock);
+  int status = job->result.status;
+  if (status == CRACK_PENDING) {
+    // unlink from the queue, nothing has touched it yet
+    crack_job_t **link = &pool->head, *prev = NULL;
+    while (*link != job) {
+      prev = *link;
+      link = &(*link)->next;
+    }
+    *link = job->next;
+    if (pool->tail == job) pool->tail = prev;
+    job->result.status = CRACK_RUNNING;
+  } else if (status == CRACK_RUNNING) {
+    __atomic_store_n(&job->stop, 1, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  if (status == CRACK_PENDING) {
+    job_finish(job, CRACK_CANCELLED);
+  }
+  return status <= CRACK_RUNNING;
+}
+
+/**
+ * @brief The job's result, complete once crack_poll or crack_wait says it
+ *   finished.  It belongs to the job.
+ */
+const crack_result_t *crack_result(crack_job_t *job) {
+  return &job->result;
+}
+
+/**
+ * @brief Give a handle back.  A job still queued or running carries on
+ *   (its callback still runs) and is freed when it finishes.
+ */
+void crack_release(crack_job_t *job) {
+  crack_pool_t *pool = job->pool;
+  pthread_mutex_lock(&pool->lock);
+  job_unref(job);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * @brief Cancel every job, stop the threads and free the pool.  Handles
+ *   not yet released are freed too and must not be used afterwards.
+ */
+void crack_pool_destroy(crack_pool_t *pool) {
+  pthread_mutex_lock(&pool->lock);
+  crack_job_t *queued = pool->head;
+  pool->head = pool->tail = NULL;
+  for (crack_job_t *job = pool->all; job != NULL; job = job->next_all) {
+    if (job->result.status == CRACK_RUNNING) {
+      __atomic_store_n(&job->stop, 1, __ATOMIC_RELEASE);
+    }
+  }
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  while (queued != NULL) {
+    crack_job_t *next = queued->next;
+    queued->result.status = CRACK_RUNNING;
+    job_finish(queued, CRACK_CANCELLED);
+    queued = next;
+  }
+  for (int t = 0; t < pool->threads; t++) {
+    pthread_join(pool->thread_ids[t], NULL);
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->all != NULL) {
+    pool->all->refs = 1;
+    job_unref(pool->all);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  pthread_cond_destroy(&pool->work);
+  pthread_cond_destroy(&pool->room);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool);
+}
@@ -0,0 +1,55 @@
+/**
+ * @file crack.h
+ * @brief Header for crack.c, an in-process asynchronous API for factoring
+ *   a public key (and decrypting its ciphertext) on a shared worker pool.
+ * @version 0.1
+ * @date 2021-06-04
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef _CRACK_H
+#define _CRACK_H
+
+#include <stdint.h>
+#include <gmp.h>
+
+#include "rsa.h"
+
+#define CRACK_MAX_THREADS 64
+
+// Job status, from crack_poll and crack_wait
+#define CRACK_PENDING 0   // queued
+#define CRACK_RUNNING 1
+#define CRACK_DONE 2      // the result holds the private key
+#define CRACK_FAILED 3    // n is prime or too small to be a key
+#define CRACK_CANCELLED 4
+
+typedef struct crack_pool crack_pool_t;
+typedef struct crack_job crack_job_t;
+
+typedef struct {
+  int status;
+  rsa_keys_t keys;  // p, q, n, d and e once done, cleared otherwise
+  char *message;    // the decrypted ciphertext, NULL without one
+  int message_len;
+  uint64_t usec;    // submit to finish
+} crack_result_t;
+
+// Called once per job when it finishes, whatever the status, on the
+// thread that finished it.  It may read the result but not wait on or
+// release the job.
+typedef void (*crack_callback_t)(crack_job_t *job, void *arg);
+
+crack_pool_t *crack_pool_create(int threads, int max_jobs);
+void crack_pool_destroy(crack_pool_t *pool);
+
+crack_job_t *crack_submit(crack_pool_t *pool, const rsa_keys_t *public_keys, const char *encrypted,
+                          int enc_len, crack_callback_t callback, void *arg);
+int crack_poll(crack_job_t *job);
+int crack_wait(crack_job_t *job, int64_t timeout_usec);
+int crack_cancel(crack_job_t *job);
+const crack_result_t *crack_result(crack_job_t *job);
+void crack_release(crack_job_t *job);
+
+#endif
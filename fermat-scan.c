@@ -0,0 +1,193 @@
+/**
+ * @file fermat-scan.c
+ * @brief Audit a gen-corpus packed file for keys whose p and q are close
+ *   together: run Fermat's method on every key under a fixed budget,
+ *   list the keys it breaks and report candidates/sec.
+ *
+ *   Usage: fermat-scan [-t threads] [-B budget] packed_corpus
+ *
+ *   The budget defaults to fermat_budget from tune.txt, the threads to
+ *   batch_threads.
+ * @version 0.1
+ * @date 2021-05-31
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "rsa.h"
+#include "fermat.h"
+#include "tune.h"
+
+typedef struct {
+	mpz_t *n;            // the moduli
+	mpz_t *known;        // a private factor of each, to check against
+	size_t count;
+	size_t next;         // next key to hand out
+	uint64_t budget;
+	uint64_t candidates; // tried over all keys
+	long hits;
+	int failed;
+	pthread_mutex_t lock;
+} scan_t;
+
+struct timespec timer_start()
+{
+	struct timespec tick;
+	clock_gettime(CLOCK_MONOTONIC, &tick);
+	return tick;
+}
+
+uint64_t timer_end(struct timespec tick)
+{
+	struct timespec tock;
+	clock_gettime(CLOCK_MONOTONIC, &tock);
+	uint64_t start_nanos = tick.tv_sec * (long)1e9 + tick.tv_nsec;
+	uint64_t end_nanos = tock.tv_sec * (long)1e9 + tock.tv_nsec;
+
+	return (end_nanos - start_nanos) / 1000;
+}
+
+/**
+ * @brief Read the moduli (and known factors) of a packed corpus.
+ */
+size_t read_corpus(const char *packed, mpz_t **n, mpz_t **p)
+{
+	FILE *fp = fopen(packed, "r");
+	if (fp == NULL) {
+		perror("could not open packed corpus");
+		exit(-1);
+	}
+
+	rsa_keys_t keys;
+	size_t count = 0, capacity = 0;
+	while (rsa_fread_private_keys(&keys, fp)) {
+		if (count == capacity) {
+			capacity = capacity ? 2 * capacity : 1024;
+			*n = realloc(*n, capacity * sizeof(mpz_t));
+			*p = realloc(*p, capacity * sizeof(mpz_t));
+		}
+		mpz_init_set((*n)[count], keys.n);
+		mpz_init_set((*p)[count], keys.p);
+		mpz_clears(keys.p, keys.q, keys.n, keys.d, keys.e, NULL);
+		count++;
+
+		// skip the encrypted length and message lines
+		fscanf(fp, "%*d %*s ");
+	}
+	fclose(fp);
+
+	return count;
+}
+
+/**
+ * @brief Method each worker follows: take keys until none are left.
+ */
+void *worker(void *input)
+{
+	scan_t *scan = (scan_t *)input;
+	uint64_t candidates = 0;
+	mpz_t p, q;
+	mpz_inits(p, q, NULL);
+
+	for (;;) {
+		pthread_mutex_lock(&scan->lock);
+		size_t i = scan->next++;
+		pthread_mutex_unlock(&scan->lock);
+		if (i >= scan->count) {
+			break;
+		}
+
+		uint64_t tried;
+		int hit = fermat(scan->n[i], p, scan->budget, &tried);
+		candidates += tried;
+		if (!hit) {
+			continue;
+		}
+
+		mpz_divexact(q, scan->n[i], p);
+		pthread_mutex_lock(&scan->lock);
+		if (mpz_cmp(p, scan->known[i]) != 0 && mpz_cmp(q, scan->known[i]) != 0) {
+			gmp_printf("Error - %Zd does not match the private key of %Zd\n", p, scan->n[i]);
+			scan->failed = 1;
+		} else {
+			mpz_sub(q, q, p);
+			mpz_abs(q, q);
+			printf("key %zu: %zu bits, |q - p| < 2^%zu, factored after %lu candidates\n",
+				i, mpz_sizeinbase(scan->n[i], 2), mpz_sizeinbase(q, 2), tried);
+			scan->hits++;
+		}
+		pthread_mutex_unlock(&scan->lock);
+	}
+
+	pthread_mutex_lock(&scan->lock);
+	scan->candidates += candidates;
+	pthread_mutex_unlock(&scan->lock);
+	mpz_clears(p, q, NULL);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	tune_load(TUNE_PROFILE, &tune_profile);
+	tune_apply(&tune_profile);
+
+	int num_threads = tune_profile.batch_threads;
+	scan_t scan = {0};
+	scan.budget = tune_profile.fermat_budget ? (uint64_t)tune_profile.fermat_budget : FERMAT_BUDGET;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:B:")) != -1) {
+		switch (opt) {
+		case 't': num_threads = atoi(optarg); break;
+		case 'B': scan.budget = strtoull(optarg, NULL, 0); break;
+		default: argc = 0;
+		}
+	}
+	if (argc - optind != 1) {
+		printf("Usage: %s [-t threads] [-B budget] packed_corpus\n", argv[0]);
+		exit(-1);
+	}
+	if (num_threads < 1 || num_threads > TUNE_MAX_THREADS) {
+		printf("Error - bad thread count\n");
+		exit(-1);
+	}
+
+	scan.count = read_corpus(argv[optind], &scan.n, &scan.known);
+	if (scan.count == 0) {
+		printf("Error - no keys in %s\n", argv[optind]);
+		exit(-1);
+	}
+	pthread_mutex_init(&scan.lock, NULL);
+
+	pthread_t thread_ids[TUNE_MAX_THREADS];
+	struct timespec t = timer_start();
+	for (int i = 0; i < num_threads; i++) {
+		pthread_create(&thread_ids[i], NULL, worker, &scan);
+	}
+	for (int i = 0; i < num_threads; i++) {
+		pthread_join(thread_ids[i], NULL);
+	}
+	uint64_t usec = timer_end(t);
+	if (usec == 0) usec = 1;
+
+	printf("fermat: %ld/%zu keys with close primes in %.3f sec, %.0f keys/sec, "
+		"%.3g candidates/sec (budget %lu, %d threads)\n",
+		scan.hits, scan.count, usec / 1e6, scan.count * 1e6 / usec,
+		scan.candidates * 1e6 / usec, scan.budget, num_threads);
+
+	for (size_t i = 0; i < scan.count; i++) {
+		mpz_clears(scan.n[i], scan.known[i], NULL);
+	}
+	free(scan.n);
+	free(scan.known);
+	pthread_mutex_destroy(&scan.lock);
+	return scan.failed;
+}
@@ -0,0 +1,144 @@
+/**
+ * @file fermat.c
+ * @brief Fermat's method: n = a^2 - b^2 = (a - b)(a + b), with a
+ *   stepped up from ceil(sqrt(n)).  When p and q are close, a = (p + q) / 2
+ *   is only about (q - p)^2 / (8 sqrt(n)) past the start, so a bad
+ *   generator's keys fall within a few steps.
+ *
+ *   a^2 - n can only be a square if it is a square modulo every small m,
+ *   which depends on a mod m alone.  For each m a table of 64-bit words
+ *   holds, for every start residue, which of the next 64 a pass mod m;
+ *   a block of 64 candidates is the AND of one word per modulus, and
+ *   only the few survivors get a full mpz_perfect_square_p.
+ * @version 0.1
+ * @date 2021-05-31
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdlib.h>
+
+#include "fermat.h"
+
+// 64, 63 = 9 * 7 and 65 = 5 * 13 reject the most per table word
+static const unsigned fermat_moduli[] = {
+  64, 63, 65, 11, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79
+};
+
+#define FERMAT_MODULI (sizeof(fermat_moduli) / sizeof(fermat_moduli[0]))
+#define FERMAT_MAX_MODULUS 79
+
+typedef struct {
+  unsigned m;
+  unsigned step;   // 64 mod m
+  unsigned r;      // a mod m at the start of the current block
+  uint64_t *words; // words[r]: bit j set if a = r + j can pass mod m
+} fermat_filter_t;
+
+/**
+ * @brief Build the table of one modulus for this n.
+ */
+static void filter_init(fermat_filter_t *f, unsigned m, const mpz_t n, const mpz_t a) {
+  unsigned char square[FERMAT_MAX_MODULUS] = {0};
+  unsigned char ok[FERMAT_MAX_MODULUS];
+
+  for (unsigned x = 0; x < m; x++) {
+    square[x * x % m] = 1;
+  }
+  unsigned nm = mpz_fdiv_ui(n, m);
+  for (unsigned r = 0; r < m; r++) {
+    ok[r] = square[(r * r + m - nm) % m];
+  }
+
+  f->m = m;
+  f->step = 64 % m;
+  f->r = mpz_fdiv_ui(a, m);
+  f->words = malloc(m * sizeof(uint64_t));
+
+  // words[r] is words[r + 1] shifted up one with ok[r] at the bottom
+  uint64_t w = 0;
+  for (int j = 63; j >= 0; j--) {
+    w = (w << 1) | ok[j % m];
+  }
+  f->words[0] = w;
+  for (unsigned r = m - 1; r > 0; r--) {
+    f->words[r] = (f->words[(r + 1) % m] << 1) | ok[r];
+  }
+}
+
+/**
+ * @brief Look for n = (a - b)(a + b) with a from ceil(sqrt(n)) up to
+ *   budget candidates past it.
+ *
+ * @param n the modulus.
+ * @param p set to a nontrivial factor if one is found.
+ * @param budget how many values of a to try.
+ * @param candidates if not NULL, set to how many were tried.
+ * @return 1 if p was set, 0 if the budget ran out.
+ */
+int fermat(const mpz_t n, mpz_t p, uint64_t budget, uint64_t *candidates) {
+  if (mpz_even_p(n)) {
+    if (candidates != NULL) *candidates = 0;
+    if (mpz_cmp_ui(n, 2) <= 0) return 0;
+    mpz_set_ui(p, 2);
+    return 1;
+  }
+
+  mpz_t a0, a, b;
+  mpz_inits(a0, a, b, NULL);
+
+  // a0 = ceil(sqrt(n))
+  mpz_sqrtrem(a0, b, n);
+  if (mpz_sgn(b) != 0) {
+    mpz_add_ui(a0, a0, 1);
+  }
+
+  fermat_filter_t filters[FERMAT_MODULI];
+  for (size_t i = 0; i < FERMAT_MODULI; i++) {
+    filter_init(&filters[i], fermat_moduli[i], n, a0);
+  }
+
+  int found = 0;
+  uint64_t base, tried = budget;
+  for (base = 0; base < budget && !found; base += 64) {
+    uint64_t mask = ~0UL;
+    for (size_t i = 0; i < FERMAT_MODULI; i++) {
+      fermat_filter_t *f = &filters[i];
+      mask &= f->words[f->r];
+      f->r += f->step;
+      if (f->r >= f->m) f->r -= f->m;
+    }
+    if (budget - base < 64) {
+      mask &= (1UL << (budget - base)) - 1;
+    }
+
+    while (mask) {
+      int j = __builtin_ctzl(mask);
+      mask &= mask - 1;
+
+      // b^2 = a^2 - n, then p = a - b unless that is 1
+      mpz_add_ui(a, a0, base + j);
+      mpz_mul(b, a, a);
+      mpz_sub(b, b, n);
+      if (!mpz_perfect_square_p(b)) continue;
+      mpz_sqrt(b, b);
+      mpz_sub(b, a, b);
+      if (mpz_cmp_ui(b, 1) == 0) continue;
+
+      mpz_set(p, b);
+      found = 1;
+      tried = base + j + 1;
+      break;
+    }
+  }
+
+  if (candidates != NULL) {
+    *candidates = tried;
+  }
+
+  for (size_t i = 0; i < FERMAT_MODULI; i++) {
+    free(filters[i].words);
+  }
+  mpz_clears(a0, a, b, NULL);
+  return found;
+}
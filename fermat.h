@@ -0,0 +1,19 @@
+/**
+ * @file fermat.h
+ * @brief Header for fermat.c, Fermat's method for keys whose p and q
+ *   are close together.
+ * @version 0.1
+ * @date 2021-05-31
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef _FERMAT_H
+#define _FERMAT_H
+
+#include <stdint.h>
+#include <gmp.h>
+
+int fermat(const mpz_t n, mpz_t p, uint64_t budget, uint64_t *candidates);
+
+#endif
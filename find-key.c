@@ -23,8 +23,14 @@
 // My RSA library - don't use for NSA work
 #include "rsa.h"
 #include "primefact.h"
+#include "codebook.h"
+#include "rhobatch.h"
+#include "cfrac.h"
+#include "fermat.h"
+#include "ingest.h"
+#include "place.h"
+#include "tune.h"
 
-#define NUM_THREADS 1 // Number of threads
 #define BLOCK_LEN 32	 // Max num of chars in message (in bytes)
 
 /**
@@ -65,33 +71,26 @@ void print_buff(int len, char *buf)
 }
 
 /**
- * @brief Method each thread follows upon launch. 
- * 
- * @param thread_input rsa_decrypt_t struct containing 
- *   information necessary to crack stuff. 
+ * @brief Compute d from a factor p of n.
+ *
+ * @param keys public keys, d is set.
+ * @param found_p a nontrivial factor of keys->n.
  */
-void *thread_func(void *thread_input) {
+void compute_private_key(rsa_keys_t *keys, mpz_t found_p) {
   // Create constant as mpz_t
 	mpz_t ONE; 
 	mpz_init(ONE); 
 	mpz_set_ui(ONE, 1); 
 
-	rsa_decrypt_t *thread_struct = (rsa_decrypt_t *)thread_input;
-
   // Create & initialize p
 	mpz_t p; 
 	mpz_init(p); 
-	mpz_init(thread_struct->p);
-  // Call pollardrho to find p value
-	pollardRho(thread_struct->keys->n, thread_struct);
-
-  
-	mpz_set(p, thread_struct->p); // copy p over
+	mpz_set(p, found_p); // copy p over
 
   // Create, initialize and calculate q (n/p = q)
 	mpz_t q; 
 	mpz_init(q);
-	mpz_div(q, thread_struct->keys->n, p); 
+	mpz_div(q, keys->n, p); 
 
   // Create and initialize phi_n
 	mpz_t phi_n;
@@ -105,72 +104,147 @@ void *thread_func(void *thread_input) {
 	mpz_mul(phi_n, p, q); 
 
   // Initialize keys->d, and calculate d
-	mpz_init(thread_struct->keys->d);
-	mpz_invert(thread_struct->keys->d, thread_struct->keys->e, phi_n);
+	mpz_init(keys->d);
+	mpz_invert(keys->d, keys->e, phi_n);
+	mpz_clears(ONE, p, q, phi_n, NULL);
+}
+
+/**
+ * @brief Method each thread follows upon launch. 
+ * 
+ * @param thread_input rsa_decrypt_t struct containing 
+ *   information necessary to crack stuff. 
+ */
+void *thread_func(void *thread_input) {
+	rsa_decrypt_t *thread_struct = (rsa_decrypt_t *)thread_input;
+
+	mpz_init(thread_struct->p);
+	place_pin(place_policy(tune_profile.placement), thread_struct->seed);
+  // Call pollardrho to find p value, the threads that lose the race stop
+	if (pollardRho(thread_struct->keys->n, thread_struct)) {
+		compute_private_key(thread_struct->keys, thread_struct->p);
+	}
+	mpz_clear(thread_struct->p);
+	return NULL;
 }
 
 int main(int argc, char **argv) {
+	// Thread count, kernel and crossovers come from autotune's profile
+	if (tune_load(TUNE_PROFILE, &tune_profile)) {
+		printf("Loaded tuning profile %s\n", TUNE_PROFILE);
+	} else {
+		printf("No %s, using built-in tuning (run ./autotune)\n", TUNE_PROFILE);
+	}
+	tune_apply(&tune_profile);
+	int num_threads = tune_profile.threads;
+
 	char *encrypted = malloc(1024 * 2);
 	char *decrypted = malloc(1024 * 2);
-	char *fname = malloc(1024);
-	int keysize[] = {12, 20, 32, 40, 50, 54, 56, 60, 64, 70, 80, 90, 100, 110, 120, 140, 160, 180, 200}; 
 
-	for (int j = 0; j < 19; j++) {
-    printf("Reading keysize[%d]: %d bit key\n", j, keysize[j]);
+	// Every key in keys/ smallest first, read and parsed ahead of the
+	// factoring on the ingest threads
+	ingest_t *in = ingest_open("keys", tune_profile.batch_threads, INGEST_DEPTH, INGEST_URING);
+	printf("Reading %zu keys with %s\n", ingest_count(in), ingest_backend(in));
+	ingest_item_t *item;
+
+	while ((item = ingest_next(in)) != NULL) {
+    int keysize = atoi(item->name);
+    printf("Reading keysize[%zu]: %d bit key\n", item->index, keysize);
     int *found = calloc(10, sizeof(int));
-		// int keysize; // user input, key to run
 		rsa_keys_t keys; // the RSA keys
 
-		// printf("Enter key size: ");
-		// scanf("%d", &keysize); // scanf bad but i'm lazy, change this to fgets later
-
-		// Read public keys from file
-		sprintf(fname, "keys/public-%d.txt", keysize[j]);
-    printf("fname: %s\n", fname);
-		rsa_read_public_keys(&keys, fname);
+		// Our own copy of the public key, the ingest reuses its storage
+		keys.num_bits = item->keys.num_bits;
+		keys.enc_block_size = item->keys.enc_block_size;
+		keys.dec_block_size = item->keys.dec_block_size;
+		mpz_inits(keys.p, keys.q, keys.d, NULL);
+		mpz_init_set(keys.n, item->keys.n);
+		mpz_init_set(keys.e, item->keys.e);
 
-		// printf("Reading encrypted message\n");
-		sprintf(fname, "keys/encrypted-%d.dat", keysize[j]);
-    printf("fname: %s\n", fname);
-		FILE *fp = fopen(fname, "r+");
-
-		if (fp == NULL) { 
-			perror("could not open encrypted text");
+		if (item->encrypted == NULL) { 
+			printf("Error - no encrypted-%s.dat\n", item->name);
 			exit(-1);
 		}
 
-		int bytes = fread(encrypted, 1, BLOCK_LEN * (keysize[j] / 8), fp);
+		int bytes = item->enc_len;
+		if (bytes > BLOCK_LEN * (keysize / 8)) bytes = BLOCK_LEN * (keysize / 8);
+		memcpy(encrypted, item->encrypted, bytes);
 		printf("Read %d bytes\n", bytes);
-		fclose(fp);
 
 		struct timespec t = timer_start(); // Start timer
 
-		pthread_t thread_ids[NUM_THREADS];
-		rsa_decrypt_t concurrent_keys[NUM_THREADS];
+		// Small blocks are cheaper to look up than to factor
+		if (codebook_predicted_faster(&keys)) {
+			int len = codebook_decrypt(&keys, encrypted, bytes, decrypted);
+			if (len >= 0) {
+				decrypted[len] = 0;
+				printf("Codebook message: %s\n", decrypted);
+				goto done;
+			}
+			printf("Codebook failed, factoring n\n");
+		}
+
+		pthread_t thread_ids[TUNE_MAX_THREADS];
+		rsa_decrypt_t concurrent_keys[TUNE_MAX_THREADS];
 
-		// Initialize concurrent_keys[i]
-		for (int i = 0; i < NUM_THREADS; i++) {
+		// Initialize concurrent_keys[i], each thread on its own walk
+		for (int i = 0; i < num_threads; i++) {
 			concurrent_keys[i].keys = &keys;
 			concurrent_keys[i].found = found;
+			concurrent_keys[i].seed = i;
+		}
+
+		if (tune_profile.fermat_budget > 0) {
+			// A weak generator's close p and q fall out in a few steps
+			mpz_init(concurrent_keys[0].p);
+			if (fermat(keys.n, concurrent_keys[0].p, tune_profile.fermat_budget, NULL)) {
+				printf("Fermat found p close to q\n");
+				*found = 1;
+				compute_private_key(&keys, concurrent_keys[0].p);
+			}
+			mpz_clear(concurrent_keys[0].p);
+		}
+
+		if (!*found && tune_use_cfrac(&tune_profile, keys.num_bits)) {
+			// Past the crossover the continued fraction method wins outright
+			mpz_init(concurrent_keys[0].p);
+			cfrac(keys.n, &concurrent_keys[0]);
+			if (*found) {
+				compute_private_key(&keys, concurrent_keys[0].p);
+			}
+			mpz_clear(concurrent_keys[0].p);
 		}
 
-		// Launch threads
-		for (int i = 0; i < NUM_THREADS; i++) {
-			pthread_create(&thread_ids[i], NULL, thread_func, &concurrent_keys[i]);
+		if (!*found && tune_use_rho_batch(&tune_profile, keys.num_bits)) {
+			// One walk per lane of the engine beats racing pollardRho here
+			mpz_init(concurrent_keys[0].p);
+			if (rho_batch_race(&keys.n, &concurrent_keys[0].p, NULL) == 1) {
+				*found = 1;
+				compute_private_key(&keys, concurrent_keys[0].p);
+			}
+			mpz_clear(concurrent_keys[0].p);
 		}
 
-		// Rejoin threads
-		for (int i = 0; i < NUM_THREADS; i++)	{
-			pthread_join(thread_ids[i], NULL);
+		if (!*found) {
+			// Launch threads
+			for (int i = 0; i < num_threads; i++) {
+				pthread_create(&thread_ids[i], NULL, thread_func, &concurrent_keys[i]);
+			}
+
+			// Rejoin threads
+			for (int i = 0; i < num_threads; i++)	{
+				pthread_join(thread_ids[i], NULL);
+			}
 		}
 
 		// Decrypt 
 		rsa_decrypt(encrypted, decrypted, bytes, &keys);
 		printf("Message: %s\n", decrypted);
 
+	done:;
 		uint64_t endtimer = timer_end(t);
     FILE *write = fopen("times.txt", "a");
-    fprintf(write, "%d bit key took %lu usec\tmsg:\t%s\n", keysize[j], endtimer, decrypted);
+    fprintf(write, "%d bit key took %lu usec\tmsg:\t%s\n", keysize, endtimer, decrypted);
     fclose(write); 
     mpz_clear(keys.d);
     mpz_clear(keys.n);
@@ -180,9 +254,9 @@ int main(int argc, char **argv) {
 	}
 
   // Free up the memory we gobbled up
+  ingest_close(in);
   free(encrypted);
   free(decrypted);
-  free(fname);
 
   exit(0);
 }
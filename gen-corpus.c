@@ -0,0 +1,282 @@
+/**
+ * @file gen-corpus.c
+ * @brief Non-interactive bulk generator for key/test corpora.  Writes
+ *   the same public, private and encrypted files make-test does, for
+ *   many keys per bit size, using a pool of threads that each own a
+ *   seeded random state.  Reports keys/sec for every bit size.
+ *
+ *   Usage: gen-corpus [-b bits,bits,...] [-n keys] [-t threads]
+ *                     [-s seed] [-o dir | -p packed_file] [-m text]
+ *                     [-g gap_bits]
+ *
+ *   With -s the corpus is a pure function of the seed (every key gets
+ *   its own state seeded from seed, bit size and index), whatever the
+ *   thread count.  With -p every key goes into one packed file instead,
+ *   as the private key file text followed by a line holding the number
+ *   of encrypted bytes and a line of the encrypted message in hex.
+ *   With -g every q is within 2^gap_bits of its p, the way a weak
+ *   generator makes them, for auditing with fermat-scan.
+ * @version 0.1
+ * @date 2021-05-22
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "rsa.h"
+
+#define MAX_SIZES 64
+#define MAX_MSG_LEN 2048
+#define MAX_THREADS 256
+
+typedef struct {
+	int bits;           // key size being generated
+	long num_keys;      // keys to make at this size
+	long next;          // next key index to hand out
+	int seeded;         // use a deterministic per-key seed
+	unsigned long seed;
+	const char *dir;    // output directory, or NULL
+	FILE *packed;       // packed output, or NULL
+	const char *message;
+	unsigned int gap_bits; // q within 2^gap_bits of p, 0 for independent
+	pthread_mutex_t lock;
+} corpus_t;
+
+struct timespec timer_start()
+{
+	struct timespec tick;
+	clock_gettime(CLOCK_MONOTONIC, &tick);
+	return tick;
+}
+
+uint64_t timer_end(struct timespec tick)
+{
+	struct timespec tock;
+	clock_gettime(CLOCK_MONOTONIC, &tock);
+	uint64_t start_nanos = tick.tv_sec * (long)1e9 + tick.tv_nsec;
+	uint64_t end_nanos = tock.tv_sec * (long)1e9 + tock.tv_nsec;
+
+	return (end_nanos - start_nanos) / 1000;
+}
+
+/**
+ * @brief Seed a thread's random state from the system, once per thread.
+ */
+void seed_from_system(gmp_randstate_t state)
+{
+#ifdef linux
+	// the whole NUM_RANDOM_BYTES, like rsa_genkeys, not one word of it
+	unsigned char bytes[NUM_RANDOM_BYTES];
+	FILE *fp = fopen(RANDOM_DEVICE, "rb");
+	if (fp == NULL || fread(bytes, 1, sizeof(bytes), fp) != sizeof(bytes)) {
+		perror("could not read " RANDOM_DEVICE);
+		exit(-1);
+	}
+	fclose(fp);
+
+	mpz_t seed;
+	mpz_init(seed);
+	mpz_import(seed, sizeof(bytes), 1, 1, 0, 0, bytes);
+	gmp_randseed(state, seed);
+	mpz_clear(seed);
+#else
+	gmp_randseed_ui(state, time(NULL) ^ (unsigned long)pthread_self());
+#endif
+}
+
+/**
+ * @brief Seed the state from (seed, bits, index) so key i of a size is
+ *   the same no matter which thread makes it.
+ */
+void seed_for_key(gmp_randstate_t state, unsigned long seed, int bits, long index)
+{
+	mpz_t s;
+	mpz_init_set_ui(s, seed);
+	mpz_mul_2exp(s, s, 32);
+	mpz_add_ui(s, s, bits);
+	mpz_mul_2exp(s, s, 64);
+	mpz_add_ui(s, s, index);
+	gmp_randseed(state, s);
+	mpz_clear(s);
+}
+
+/**
+ * @brief Make one key, encrypt the message and write it all out.
+ */
+void make_key(corpus_t *corpus, long index, gmp_randstate_t state)
+{
+	char message[MAX_MSG_LEN + 12];
+	char fname[1024];
+	rsa_keys_t keys;
+
+	rsa_genkeys_gap(corpus->bits, &keys, state, corpus->gap_bits);
+
+	// same message layout as make-test, including the trailing 0
+	snprintf(message, sizeof(message), "<h1>%s</h1>", corpus->message);
+	int len = strlen(message) + 1;
+	int blocks = (len + keys.enc_block_size - 1) / keys.enc_block_size;
+	char *encrypted = malloc(blocks * keys.dec_block_size);
+	int enc_len = rsa_encrypt_batch(message, encrypted, len, &keys);
+
+	if (corpus->packed != NULL) {
+		// build the record first so it goes out in one locked write
+		char *record;
+		size_t record_len;
+		FILE *mem = open_memstream(&record, &record_len);
+		rsa_fwrite_private_keys(&keys, mem);
+		fprintf(mem, "%d\n", enc_len);
+		for (int i = 0; i < enc_len; i++) {
+			fprintf(mem, "%02x", (unsigned char)encrypted[i]);
+		}
+		fprintf(mem, "\n");
+		fclose(mem);
+
+		pthread_mutex_lock(&corpus->lock);
+		fwrite(record, 1, record_len, corpus->packed);
+		pthread_mutex_unlock(&corpus->lock);
+		free(record);
+	} else {
+		sprintf(fname, "%s/encrypted-%d-%ld.dat", corpus->dir, corpus->bits, index);
+		FILE *fp = fopen(fname, "w+");
+		if (fp == NULL) {
+			perror("could not write encrypted text");
+			exit(-1);
+		}
+		fwrite(encrypted, 1, enc_len, fp);
+		fclose(fp);
+
+		sprintf(fname, "%s/private-%d-%ld.txt", corpus->dir, corpus->bits, index);
+		rsa_write_private_keys(&keys, fname);
+		sprintf(fname, "%s/public-%d-%ld.txt", corpus->dir, corpus->bits, index);
+		rsa_write_public_keys(&keys, fname);
+	}
+
+	free(encrypted);
+	mpz_clears(keys.p, keys.q, keys.n, keys.d, keys.e, NULL);
+}
+
+/**
+ * @brief Method each worker follows: take key indices until none are left.
+ */
+void *worker(void *input)
+{
+	corpus_t *corpus = (corpus_t *)input;
+	gmp_randstate_t state;
+	gmp_randinit_mt(state);
+	if (!corpus->seeded) {
+		seed_from_system(state);
+	}
+
+	for (;;) {
+		pthread_mutex_lock(&corpus->lock);
+		long index = corpus->next++;
+		pthread_mutex_unlock(&corpus->lock);
+
+		if (index >= corpus->num_keys) {
+			break;
+		}
+		if (corpus->seeded) {
+			seed_for_key(state, corpus->seed, corpus->bits, index);
+		}
+		make_key(corpus, index, state);
+	}
+
+	gmp_randclear(state);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	int sizes[MAX_SIZES];
+	int num_sizes = 0;
+	char *bit_list = "32,64,100,128";
+	long num_keys = 1000;
+	int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *packed_name = NULL;
+	corpus_t corpus = {0};
+	int opt;
+
+	corpus.dir = "corpus";
+	corpus.message = "test message";
+
+	while ((opt = getopt(argc, argv, "b:n:t:s:o:p:m:g:")) != -1) {
+		switch (opt) {
+		case 'b': bit_list = optarg; break;
+		case 'n': num_keys = atol(optarg); break;
+		case 't': num_threads = atoi(optarg); break;
+		case 's': corpus.seeded = 1; corpus.seed = strtoul(optarg, NULL, 0); break;
+		case 'o': corpus.dir = optarg; break;
+		case 'p': packed_name = optarg; break;
+		case 'm': corpus.message = optarg; break;
+		case 'g': corpus.gap_bits = atoi(optarg); break;
+		default:
+			printf("Usage: %s [-b bits,bits,...] [-n keys] [-t threads] "
+				"[-s seed] [-o dir | -p packed_file] [-m text] [-g gap_bits]\n", argv[0]);
+			exit(-1);
+		}
+	}
+
+	for (char *tok = strtok(bit_list, ","); tok && num_sizes < MAX_SIZES;
+		tok = strtok(NULL, ",")) {
+		sizes[num_sizes] = atoi(tok);
+		// below 9 bits the encryption block size is 0
+		if (sizes[num_sizes] < 9) {
+			printf("Error - key sizes must be at least 9 bits\n");
+			exit(-1);
+		}
+		// q must stay the size of p
+		if (corpus.gap_bits >= (unsigned int)sizes[num_sizes] / 2) {
+			printf("Error - gap_bits must be below half of %d bits\n", sizes[num_sizes]);
+			exit(-1);
+		}
+		num_sizes++;
+	}
+	if (num_threads < 1) num_threads = 1;
+	if (num_threads > MAX_THREADS) num_threads = MAX_THREADS;
+
+	if (packed_name != NULL) {
+		corpus.packed = fopen(packed_name, "w+");
+		if (corpus.packed == NULL) {
+			perror("could not open packed corpus");
+			exit(-1);
+		}
+	} else {
+		mkdir(corpus.dir, 0755);
+	}
+	pthread_mutex_init(&corpus.lock, NULL);
+
+	printf("%ld keys per size, %d threads\n", num_keys, num_threads);
+	for (int j = 0; j < num_sizes; j++) {
+		pthread_t thread_ids[MAX_THREADS];
+
+		corpus.bits = sizes[j];
+		corpus.num_keys = num_keys;
+		corpus.next = 0;
+
+		struct timespec t = timer_start();
+		for (int i = 0; i < num_threads; i++) {
+			pthread_create(&thread_ids[i], NULL, worker, &corpus);
+		}
+		for (int i = 0; i < num_threads; i++) {
+			pthread_join(thread_ids[i], NULL);
+		}
+		uint64_t usec = timer_end(t);
+
+		printf("%5d bits: %ld keys in %.3f sec, %.0f keys/sec\n", sizes[j],
+			num_keys, usec / 1e6, num_keys * 1e6 / (usec ? usec : 1));
+	}
+
+	if (corpus.packed != NULL) {
+		fclose(corpus.packed);
+	}
+	pthread_mutex_destroy(&corpus.lock);
+	return 0;
+}
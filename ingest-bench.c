@@ -0,0 +1,226 @@
+/**
+ * @file ingest-bench.c
+ * @brief Load a key directory (keys/ or a gen-corpus -o directory) the
+ *   old way, with rsa_read_public_keys and an fopen/fread per ciphertext,
+ *   then through ingest.h on the thread fallback and on io_uring.  For
+ *   each it reports files/sec and how long until the first key reaches
+ *   the factoring stage, here a Fermat pass of -F candidates per key.
+ *
+ *   Usage: ingest-bench [-t threads] [-q depth] [-F budget] [-u] dir
+ *
+ *   -u lets ingest hand the keys out in directory order, so it starts
+ *   reading before the whole directory is listed.
+ * @version 0.1
+ * @date 2021-06-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "rsa.h"
+#include "fermat.h"
+#include "ingest.h"
+
+typedef struct {
+	size_t keys;
+	size_t files;
+	uint64_t first_usec; // start to the first key handed to the factoring stage
+	uint64_t usec;
+	uint64_t checksum;   // of every n and ciphertext, to compare the loaders
+} run_t;
+
+struct timespec timer_start()
+{
+	struct timespec tick;
+	clock_gettime(CLOCK_MONOTONIC, &tick);
+	return tick;
+}
+
+uint64_t timer_end(struct timespec tick)
+{
+	struct timespec tock;
+	clock_gettime(CLOCK_MONOTONIC, &tock);
+	uint64_t start_nanos = tick.tv_sec * (long)1e9 + tick.tv_nsec;
+	uint64_t end_nanos = tock.tv_sec * (long)1e9 + tock.tv_nsec;
+
+	return (end_nanos - start_nanos) / 1000;
+}
+
+typedef struct {
+	long bits, index;
+	char *name;
+} name_t;
+
+// same order as ingest.c: key size, then index
+int name_cmp(const void *a, const void *b)
+{
+	const name_t *x = a, *y = b;
+	if (x->bits != y->bits) return x->bits < y->bits ? -1 : 1;
+	if (x->index != y->index) return x->index < y->index ? -1 : 1;
+	return 0;
+}
+
+/**
+ * @brief The factoring stage: fold the key into the checksum and try
+ *   Fermat on it.
+ */
+void consume(run_t *run, const mpz_t n, const char *encrypted, int enc_len, uint64_t budget)
+{
+	// summed per key, so it does not depend on the order
+	uint64_t h = mpz_getlimbn(n, 0) + mpz_size(n);
+	for (int i = 0; i < enc_len; i++) {
+		h = h * 31 + (unsigned char)encrypted[i];
+	}
+	run->checksum += h;
+	if (budget > 0) {
+		mpz_t p;
+		mpz_init(p);
+		fermat(n, p, budget, NULL);
+		mpz_clear(p);
+	}
+}
+
+/**
+ * @brief One fopen/fscanf per key and one fopen/fread per ciphertext,
+ *   the way find-key read keys/.
+ */
+void run_stdio(const char *dir, uint64_t budget, run_t *run)
+{
+	char fname[1024];
+	char *encrypted = malloc(INGEST_MAX_FILE);
+	struct timespec t = timer_start();
+
+	DIR *d = opendir(dir);
+	if (d == NULL) {
+		perror("could not open key directory");
+		exit(-1);
+	}
+	name_t *names = NULL;
+	size_t count = 0, capacity = 0;
+	struct dirent *entry;
+	while ((entry = readdir(d)) != NULL) {
+		size_t len = strlen(entry->d_name);
+		if (strncmp(entry->d_name, "public-", 7) != 0 || len < 12 ||
+			strcmp(entry->d_name + len - 4, ".txt") != 0) {
+			continue;
+		}
+		if (count == capacity) {
+			capacity = capacity ? 2 * capacity : 1024;
+			names = realloc(names, capacity * sizeof(name_t));
+		}
+		char *end;
+		names[count].name = strndup(entry->d_name + 7, len - 11);
+		names[count].bits = strtol(names[count].name, &end, 10);
+		names[count].index = *end == '-' ? strtol(end + 1, NULL, 10) : -1;
+		count++;
+	}
+	closedir(d);
+	qsort(names, count, sizeof(name_t), name_cmp);
+
+	memset(run, 0, sizeof(*run));
+	for (size_t i = 0; i < count; i++) {
+		rsa_keys_t keys;
+		snprintf(fname, sizeof(fname), "%s/public-%s.txt", dir, names[i].name);
+		rsa_read_public_keys(&keys, fname);
+		run->files++;
+
+		int bytes = 0;
+		snprintf(fname, sizeof(fname), "%s/encrypted-%s.dat", dir, names[i].name);
+		FILE *fp = fopen(fname, "r");
+		if (fp != NULL) {
+			bytes = fread(encrypted, 1, INGEST_MAX_FILE, fp);
+			fclose(fp);
+			run->files++;
+		}
+
+		if (i == 0) run->first_usec = timer_end(t);
+		consume(run, keys.n, encrypted, bytes, budget);
+		run->keys++;
+		mpz_clears(keys.p, keys.q, keys.n, keys.d, keys.e, NULL);
+		free(names[i].name);
+	}
+	run->usec = timer_end(t);
+	free(names);
+	free(encrypted);
+}
+
+/**
+ * @brief The same through ingest.h.
+ */
+void run_ingest(const char *dir, int threads, int depth, int flags, uint64_t budget,
+	run_t *run, const char **name)
+{
+	struct timespec t = timer_start();
+	ingest_t *in = ingest_open(dir, threads, depth, flags);
+	*name = ingest_backend(in);
+
+	memset(run, 0, sizeof(*run));
+	ingest_item_t *item;
+	while ((item = ingest_next(in)) != NULL) {
+		if (run->keys == 0) run->first_usec = timer_end(t);
+		consume(run, item->keys.n, item->encrypted, item->enc_len, budget);
+		run->keys++;
+	}
+	run->usec = timer_end(t);
+
+	ingest_stats_t stats;
+	ingest_stats(in, &stats);
+	run->files = stats.files;
+	ingest_close(in);
+}
+
+void report(const char *name, const run_t *run)
+{
+	uint64_t usec = run->usec ? run->usec : 1;
+	printf("%-9s %8zu %8zu %10.3f %12.0f %12.3f\n", name, run->keys, run->files,
+		run->usec / 1e6, run->files * 1e6 / usec, run->first_usec / 1e3);
+}
+
+int main(int argc, char **argv)
+{
+	int threads = 2, depth = INGEST_DEPTH, order = 0;
+	uint64_t budget = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:q:F:u")) != -1) {
+		switch (opt) {
+		case 't': threads = atoi(optarg); break;
+		case 'q': depth = atoi(optarg); break;
+		case 'F': budget = strtoull(optarg, NULL, 0); break;
+		case 'u': order = INGEST_UNSORTED; break;
+		default: argc = 0;
+		}
+	}
+	if (argc - optind != 1) {
+		printf("Usage: %s [-t threads] [-q depth] [-F budget] [-u] dir\n", argv[0]);
+		exit(-1);
+	}
+	const char *dir = argv[optind];
+
+	run_t stdio_run, thread_run, uring_run;
+	const char *thread_name, *uring_name;
+	run_stdio(dir, budget, &stdio_run);
+	run_ingest(dir, threads, depth, INGEST_THREADS | order, budget, &thread_run, &thread_name);
+	run_ingest(dir, threads, depth, INGEST_URING | order, budget, &uring_run, &uring_name);
+
+	printf("%d threads, depth %d, Fermat budget %lu, %s\n", threads, depth, budget,
+		order ? "directory order" : "sorted");
+	printf("loader        keys    files        sec    files/sec  first key ms\n");
+	report("stdio", &stdio_run);
+	report(thread_name, &thread_run);
+	report(uring_name, &uring_run);
+
+	if (thread_run.checksum != stdio_run.checksum || uring_run.checksum != stdio_run.checksum ||
+		thread_run.keys != stdio_run.keys || uring_run.keys != stdio_run.keys) {
+		printf("Error - the loaders read different keys\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,749 @@
+/**
+ * @file ingest.c
+ * @brief Batched loading of a key directory.  Reading keys one by one
+ *   costs an fopen, a handful of buffered reads and an fclose per file,
+ *   all blocking, before the first key can be factored.  Here:
+ *
+ *   - the directory is listed once and sorted by key size, then index
+ *   - with io_uring, one thread keeps up to depth keys in flight.  Every
+ *     file is an open, read and close linked together on a registered
+ *     (direct) descriptor, so it takes no fd and one trip through the
+ *     ring, and a whole round of keys goes in with one io_uring_enter.
+ *     Holding many ordinary fds would grow the fd table, which in a
+ *     threaded process waits out an RCU grace period every time.
+ *     Without io_uring 5.17 (old kernel, seccomp) the worker threads do
+ *     blocking open/read/close themselves.
+ *   - worker threads parse the hex into mpz storage that each of the
+ *     depth slots allocates once
+ *   - ingest_next hands the keys out in directory order, so the reads
+ *     run at most depth keys ahead of whatever is factoring them
+ * @version 0.1
+ * @date 2021-06-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "ingest.h"
+
+#define INGEST_MAX_THREADS 64
+#define INGEST_MPZ_BITS 256  // preallocated size of every slot's numbers
+
+enum { SLOT_FREE, SLOT_READING, SLOT_READ, SLOT_READY };
+enum { OP_OPEN, OP_READ, OP_CLOSE };
+
+// One key in flight.  Key i always goes through slot i % depth.
+typedef struct {
+  ingest_item_t item;
+  char path[2][INGEST_NAME_LEN + 16]; // public-<name>.txt, encrypted-<name>.dat
+  char *buf[2];                       // their contents, NUL terminated
+  int len[2];                         // bytes read, -1 for a missing file
+  int ops;                            // io_uring operations still out
+  int state;
+} ingest_slot_t;
+
+// A key of the directory, sorted on the numbers in its name
+typedef struct {
+  long bits;
+  long index;      // -1 for keys/ style names without one
+  size_t name;     // offset of the name in the name arena
+} ingest_name_t;
+
+// The parts of an io_uring set up by hand, liburing is not needed
+typedef struct {
+  int fd;
+  unsigned entries;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_map, *cq_map;
+  size_t sq_len, cq_len, sqe_len;
+  unsigned tail;                      // next sqe, published by ring_submit
+  unsigned queued;                    // sqes not submitted yet
+} ingest_ring_t;
+
+struct ingest {
+  int dirfd;
+  ingest_name_t *names;
+  char *arena;        // the names, NUL separated
+  size_t count;
+  ingest_slot_t *slots;
+  int depth;
+  int backend;
+  ingest_ring_t ring;
+
+  size_t next_read;   // next key to start reading
+  size_t next_out;    // next key ingest_next returns
+  size_t *parse;      // keys read and waiting for a parser, at most depth
+  size_t parse_head, parse_tail;
+  int sorted;         // hand keys out sorted, listing the directory first
+  int listed;         // names holds the whole directory
+  int reads_done;     // the ring thread has nothing more to read
+  int stop;
+
+  int num_threads;
+  pthread_t threads[INGEST_MAX_THREADS + 2]; // workers, the ring thread, the lister
+  pthread_mutex_t lock;
+  pthread_cond_t work;  // a slot came free, a key was read, or stop
+  pthread_cond_t ready; // a key is ready for ingest_next
+
+  struct timespec start;
+  ingest_stats_t stats;
+};
+
+static uint64_t usec_since(struct timespec tick) {
+  struct timespec tock;
+  clock_gettime(CLOCK_MONOTONIC, &tock);
+  return (tock.tv_sec - tick.tv_sec) * 1000000 + (tock.tv_nsec - tick.tv_nsec) / 1000;
+}
+
+/**
+ * @brief Order names by key size, then by index: "12" < "64" < "64-2" < "64-10".
+ */
+static int name_cmp(const void *a, const void *b) {
+  const ingest_name_t *x = a, *y = b;
+  if (x->bits != y->bits) return x->bits < y->bits ? -1 : 1;
+  if (x->index != y->index) return x->index < y->index ? -1 : 1;
+  return 0;
+}
+
+/**
+ * @brief Every <name> with a public-<name>.txt in the directory.  Sorted,
+ *   the numbers are parsed once here so the sort compares integers.
+ *   Unsorted, this runs on its own thread and the readers start on the
+ *   first names while the rest of the directory is still being listed.
+ */
+static void list_keys(ingest_t *in) {
+  DIR *dir = fdopendir(dup(in->dirfd));
+  if (dir == NULL) {
+    perror("could not list key directory");
+    exit(-1);
+  }
+
+  size_t capacity = 0, arena_len = 0, arena_cap = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    size_t len = strlen(entry->d_name);
+    if (strncmp(entry->d_name, "public-", 7) != 0 || len < 12 || len - 11 >= INGEST_NAME_LEN ||
+        strcmp(entry->d_name + len - 4, ".txt") != 0) {
+      continue;
+    }
+    if (!in->sorted) {
+      pthread_mutex_lock(&in->lock);
+      if (in->stop) {
+        pthread_mutex_unlock(&in->lock);
+        break;
+      }
+    }
+    if (in->count == capacity) {
+      capacity = capacity ? 2 * capacity : 1024;
+      in->names = realloc(in->names, capacity * sizeof(ingest_name_t));
+    }
+    if (arena_len + len > arena_cap) {
+      arena_cap = arena_cap ? 2 * arena_cap : 16384;
+      in->arena = realloc(in->arena, arena_cap);
+    }
+
+    char *name = in->arena + arena_len, *end;
+    memcpy(name, entry->d_name + 7, len - 11);
+    name[len - 11] = 0;
+    ingest_name_t *n = &in->names[in->count++];
+    n->bits = strtol(name, &end, 10);
+    n->index = *end == '-' ? strtol(end + 1, NULL, 10) : -1;
+    n->name = arena_len;
+    arena_len += len - 10;
+    if (!in->sorted) {
+      if (in->count % 64 == 1) pthread_cond_broadcast(&in->work);
+      pthread_mutex_unlock(&in->lock);
+    }
+  }
+  closedir(dir);
+
+  if (in->sorted) {
+    qsort(in->names, in->count, sizeof(ingest_name_t), name_cmp);
+  }
+  pthread_mutex_lock(&in->lock);
+  in->listed = 1;
+  pthread_cond_broadcast(&in->work);
+  pthread_cond_broadcast(&in->ready);
+  pthread_mutex_unlock(&in->lock);
+}
+
+static void *list_thread(void *input) {
+  list_keys((ingest_t *)input);
+  return NULL;
+}
+
+/**
+ * @brief Read one hex number, NUL terminating it in place.
+ *
+ * @return the text after it, NULL if there is no number.
+ */
+static char *parse_hex(mpz_t x, char *s) {
+  while (isspace((unsigned char)*s)) s++;
+  char *end = s;
+  while (isxdigit((unsigned char)*end)) end++;
+  if (end == s) return NULL;
+
+  char c = *end;
+  *end = 0;
+  mpz_set_str(x, s, 16);
+  *end = c;
+  return end;
+}
+
+/**
+ * @brief Parse the public key text of a slot, the rsa_write_public_keys
+ *   format.
+ */
+static void parse_slot(ingest_slot_t *s) {
+  rsa_keys_t *keys = &s->item.keys;
+  char *text = s->buf[0], *end;
+  char *line = strchr(text, '\n');
+
+  if (strncmp(text, "KEY FILE", 8) != 0 || line == NULL) {
+    printf("Error - %s is not a key file\n", s->path[0]);
+    exit(-1);
+  }
+  keys->num_bits = strtoul(line + 1, &end, 10);
+  keys->enc_block_size = strtoul(end, &end, 10);
+  keys->dec_block_size = strtoul(end, &end, 10);
+
+  end = parse_hex(keys->n, end);
+  if (end != NULL) end = parse_hex(keys->e, end);
+  if (end == NULL) {
+    printf("Error - %s is not a key file\n", s->path[0]);
+    exit(-1);
+  }
+
+  s->item.encrypted = s->len[1] >= 0 ? s->buf[1] : NULL;
+  s->item.enc_len = s->len[1] >= 0 ? s->len[1] : 0;
+}
+
+/**
+ * @brief Point a slot at key i.
+ */
+static void slot_start(ingest_t *in, ingest_slot_t *s, size_t i) {
+  const char *name = in->arena + in->names[i].name;
+  snprintf(s->item.name, sizeof(s->item.name), "%s", name);
+  snprintf(s->path[0], sizeof(s->path[0]), "public-%s.txt", name);
+  snprintf(s->path[1], sizeof(s->path[1]), "encrypted-%s.dat", name);
+  s->item.index = i;
+  s->state = SLOT_READING;
+}
+
+/**
+ * @brief Whether key i may take its slot: the one before it in the same
+ *   slot is no longer held by the consumer.
+ */
+static int slot_free(const ingest_t *in, size_t i) {
+  size_t held = in->next_out > 0 ? in->next_out - 1 : 0;
+  return i < held + in->depth;
+}
+
+/**
+ * @brief Whether the next key is listed and has a slot to go to.
+ */
+static int can_read(const ingest_t *in) {
+  return in->next_read < in->count && slot_free(in, in->next_read);
+}
+
+/**
+ * @brief Whether every key has been claimed by a reader.
+ */
+static int all_read(const ingest_t *in) {
+  return in->listed && in->next_read >= in->count;
+}
+
+/**
+ * @brief A slot is parsed: count it and wake ingest_next.  Called locked.
+ */
+static void slot_ready(ingest_t *in, ingest_slot_t *s) {
+  s->state = SLOT_READY;
+  in->stats.keys++;
+  for (int f = 0; f < 2; f++) {
+    if (s->len[f] >= 0) {
+      in->stats.files++;
+      in->stats.bytes += s->len[f];
+    }
+  }
+  uint64_t usec = usec_since(in->start);
+  if (s->item.index == 0) in->stats.first_usec = usec;
+  if (in->stats.keys == in->count) in->stats.usec = usec;
+  pthread_cond_broadcast(&in->ready);
+}
+
+static void file_too_large(ingest_slot_t *s, int f) {
+  printf("Error - %s is larger than %d bytes\n", s->path[f], INGEST_MAX_FILE);
+  exit(-1);
+}
+
+/**
+ * @brief Blocking read of one file of a slot.  The ciphertext may be missing.
+ */
+static void read_file(ingest_t *in, ingest_slot_t *s, int f) {
+  int fd = openat(in->dirfd, s->path[f], O_RDONLY);
+  if (fd < 0) {
+    if (f == 1 && errno == ENOENT) {
+      s->len[f] = -1;
+      return;
+    }
+    perror("could not open key file");
+    exit(-1);
+  }
+
+  int len = 0, got = 0;
+  while (len < INGEST_MAX_FILE && (got = read(fd, s->buf[f] + len, INGEST_MAX_FILE - len)) > 0) {
+    len += got;
+  }
+  if (got < 0) {
+    perror("could not read key file");
+    exit(-1);
+  }
+  if (len == INGEST_MAX_FILE) file_too_large(s, f);
+  close(fd);
+  s->buf[f][len] = 0;
+  s->len[f] = len;
+}
+
+/**
+ * @brief Fallback worker: claim the next key, read and parse it.
+ */
+static void *read_worker(void *input) {
+  ingest_t *in = (ingest_t *)input;
+
+  pthread_mutex_lock(&in->lock);
+  for (;;) {
+    while (!in->stop && !can_read(in) && !all_read(in)) {
+      pthread_cond_wait(&in->work, &in->lock);
+    }
+    if (in->stop || all_read(in)) {
+      break;
+    }
+    size_t i = in->next_read++;
+    ingest_slot_t *s = &in->slots[i % in->depth];
+    slot_start(in, s, i);
+    pthread_mutex_unlock(&in->lock);
+
+    read_file(in, s, 0);
+    read_file(in, s, 1);
+    parse_slot(s);
+
+    pthread_mutex_lock(&in->lock);
+    slot_ready(in, s);
+  }
+  pthread_mutex_unlock(&in->lock);
+  return NULL;
+}
+
+/**
+ * @brief io_uring worker: parse the keys the ring thread has read.
+ */
+static void *parse_worker(void *input) {
+  ingest_t *in = (ingest_t *)input;
+
+  pthread_mutex_lock(&in->lock);
+  for (;;) {
+    while (!in->stop && in->parse_head == in->parse_tail && !in->reads_done) {
+      pthread_cond_wait(&in->work, &in->lock);
+    }
+    if (in->stop || in->parse_head == in->parse_tail) {
+      break;
+    }
+    size_t i = in->parse[in->parse_head++ % in->depth];
+    ingest_slot_t *s = &in->slots[i % in->depth];
+    pthread_mutex_unlock(&in->lock);
+
+    parse_slot(s);
+
+    pthread_mutex_lock(&in->lock);
+    slot_ready(in, s);
+  }
+  pthread_mutex_unlock(&in->lock);
+  return NULL;
+}
+
+/**
+ * @brief Unmap whichever of the three mappings succeeded and close the ring.
+ */
+static void ring_free(ingest_ring_t *r) {
+  if (r->sqes != MAP_FAILED) {
+    munmap(r->sqes, r->sqe_len);
+  }
+  if (r->cq_map != MAP_FAILED) {
+    munmap(r->cq_map, r->cq_len);
+  }
+  if (r->sq_map != MAP_FAILED) {
+    munmap(r->sq_map, r->sq_len);
+  }
+  close(r->fd);
+}
+
+/**
+ * @brief Set up a ring with a table of num_files direct descriptors.
+ *
+ * @return 0 if this kernel cannot do what the reader needs.
+ */
+static int ring_setup(ingest_ring_t *r, unsigned entries, const int *files, unsigned num_files) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  memset(r, 0, sizeof(*r));
+
+  r->fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (r->fd < 0) {
+    return 0;
+  }
+  r->entries = p.sq_entries;
+
+  r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  r->sqe_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  r->sq_map = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  r->cq_map = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+  r->sqes = mmap(NULL, r->sqe_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+  if (r->sq_map == MAP_FAILED || r->cq_map == MAP_FAILED || r->sqes == MAP_FAILED) {
+    ring_free(r);
+    return 0;
+  }
+
+  char *sq = r->sq_map, *cq = r->cq_map;
+  r->sq_head = (unsigned *)(sq + p.sq_off.head);
+  r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  r->sq_array = (unsigned *)(sq + p.sq_off.array);
+  r->cq_head = (unsigned *)(cq + p.cq_off.head);
+  r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  r->tail = *r->sq_tail;
+
+  // open-read-close chains need the read to pick up the file the open
+  // installed, which older kernels resolve too early
+  if (!(p.features & IORING_FEAT_LINKED_FILE) ||
+      syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_FILES, files, num_files) < 0) {
+    ring_free(r);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief The next free sqe, cleared.  There is always one: at most six
+ *   operations per slot are ever out and the ring has room for all.
+ */
+static struct io_uring_sqe *ring_sqe(ingest_ring_t *r) {
+  unsigned index = r->tail & *r->sq_mask;
+  struct io_uring_sqe *sqe = &r->sqes[index];
+  r->sq_array[index] = index;
+  r->tail++;
+  r->queued++;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+/**
+ * @brief Submit the queued sqes and wait for at least one completion.
+ */
+static void ring_submit(ingest_ring_t *r) {
+  __atomic_store_n(r->sq_tail, r->tail, __ATOMIC_RELEASE);
+  while (syscall(__NR_io_uring_enter, r->fd, r->queued, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+    if (errno != EINTR) {
+      perror("io_uring_enter failed");
+      exit(-1);
+    }
+  }
+  r->queued = 0;
+}
+
+/**
+ * @brief Queue one file of a key: open into its direct descriptor, read
+ *   and close, linked so each starts when the one before it is done.
+ */
+static void ring_file(ingest_t *in, size_t i, int f) {
+  ingest_slot_t *s = &in->slots[i % in->depth];
+  unsigned index = (i % in->depth) * 2 + f;
+
+  struct io_uring_sqe *sqe = ring_sqe(&in->ring);
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = in->dirfd;
+  sqe->addr = (uintptr_t)s->path[f];
+  sqe->open_flags = O_RDONLY;
+  sqe->file_index = index + 1;
+  sqe->flags = IOSQE_IO_LINK;
+  sqe->user_data = i << 4 | f << 2 | OP_OPEN;
+
+  sqe = ring_sqe(&in->ring);
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = index;
+  sqe->addr = (uintptr_t)s->buf[f];
+  sqe->len = INGEST_MAX_FILE;
+  sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+  sqe->user_data = i << 4 | f << 2 | OP_READ;
+
+  sqe = ring_sqe(&in->ring);
+  sqe->opcode = IORING_OP_CLOSE;
+  sqe->file_index = index + 1;
+  sqe->user_data = i << 4 | f << 2 | OP_CLOSE;
+  s->ops += 3;
+}
+
+/**
+ * @brief Handle one completion.  A failed open cancels the read and the
+ *   close linked to it.
+ *
+ * @return 1 if that was the last operation of its key.
+ */
+static int ring_complete(ingest_t *in, struct io_uring_cqe *cqe) {
+  size_t i = cqe->user_data >> 4;
+  int f = (cqe->user_data >> 2) & 1;
+  int op = cqe->user_data & 3;
+  ingest_slot_t *s = &in->slots[i % in->depth];
+
+  s->ops--;
+  switch (op) {
+  case OP_OPEN:
+    if (f == 1 && cqe->res == -ENOENT) {
+      s->len[f] = -1;
+    } else if (cqe->res < 0) {
+      errno = -cqe->res;
+      perror("could not open key file");
+      exit(-1);
+    }
+    break;
+  case OP_READ:
+    if (cqe->res == -ECANCELED && s->len[f] < 0) {
+      break;
+    }
+    if (cqe->res < 0) {
+      errno = -cqe->res;
+      perror("could not read key file");
+      exit(-1);
+    }
+    if (cqe->res == INGEST_MAX_FILE) file_too_large(s, f);
+    s->buf[f][cqe->res] = 0;
+    s->len[f] = cqe->res;
+    break;
+  }
+  return s->ops == 0;
+}
+
+/**
+ * @brief io_uring reader: keep up to depth keys in flight and hand the
+ *   read ones to the parsers.
+ */
+static void *ring_thread(void *input) {
+  ingest_t *in = (ingest_t *)input;
+  ingest_ring_t *r = &in->ring;
+  int inflight = 0;
+
+  pthread_mutex_lock(&in->lock);
+  for (;;) {
+    while (!in->stop && can_read(in)) {
+      size_t i = in->next_read++;
+      slot_start(in, &in->slots[i % in->depth], i);
+      ring_file(in, i, 0);
+      ring_file(in, i, 1);
+      inflight++;
+    }
+    if (inflight == 0) {
+      if (in->stop || all_read(in)) {
+        break;
+      }
+      pthread_cond_wait(&in->work, &in->lock);
+      continue;
+    }
+    pthread_mutex_unlock(&in->lock);
+
+    ring_submit(r);
+
+    // reap everything there is
+    size_t done[INGEST_DEPTH];
+    int num_done = 0;
+    unsigned head = *r->cq_head;
+    while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+      if (ring_complete(in, cqe)) {
+        done[num_done++] = cqe->user_data >> 4;
+      }
+      head++;
+      __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_lock(&in->lock);
+    for (int k = 0; k < num_done; k++) {
+      in->slots[done[k] % in->depth].state = SLOT_READ;
+      in->parse[in->parse_tail++ % in->depth] = done[k];
+      inflight--;
+    }
+    if (num_done > 0) {
+      pthread_cond_broadcast(&in->work);
+    }
+  }
+  in->reads_done = 1;
+  pthread_cond_broadcast(&in->work);
+  pthread_mutex_unlock(&in->lock);
+  return NULL;
+}
+
+/**
+ * @brief Start loading a key directory.
+ *
+ * @param dir the directory, with public-<name>.txt and encrypted-<name>.dat files.
+ * @param threads worker threads that read (without io_uring) and parse.
+ * @param depth keys read ahead of the consumer, at most INGEST_DEPTH.
+ * @param flags INGEST_URING or INGEST_THREADS, plus INGEST_UNSORTED to
+ *   take the keys in whatever order the directory lists them.
+ */
+ingest_t *ingest_open(const char *dir, int threads, int depth, int flags) {
+  ingest_t *in = calloc(1, sizeof(ingest_t));
+  clock_gettime(CLOCK_MONOTONIC, &in->start);
+  pthread_mutex_init(&in->lock, NULL);
+  pthread_cond_init(&in->work, NULL);
+  pthread_cond_init(&in->ready, NULL);
+
+  in->dirfd = open(dir, O_RDONLY | O_DIRECTORY);
+  if (in->dirfd < 0) {
+    perror("could not open key directory");
+    exit(-1);
+  }
+  in->sorted = !(flags & INGEST_UNSORTED);
+  if (in->sorted) {
+    list_keys(in);
+  }
+
+  if (threads < 1) threads = 1;
+  if (threads > INGEST_MAX_THREADS) threads = INGEST_MAX_THREADS;
+  if (depth < 2) depth = 2;
+  if (depth > INGEST_DEPTH) depth = INGEST_DEPTH;
+  in->depth = depth;
+
+  in->slots = calloc(depth, sizeof(ingest_slot_t));
+  for (int k = 0; k < depth; k++) {
+    rsa_keys_t *keys = &in->slots[k].item.keys;
+    mpz_init2(keys->p, INGEST_MPZ_BITS);
+    mpz_init2(keys->q, INGEST_MPZ_BITS);
+    mpz_init2(keys->n, INGEST_MPZ_BITS);
+    mpz_init2(keys->d, INGEST_MPZ_BITS);
+    mpz_init2(keys->e, INGEST_MPZ_BITS);
+    in->slots[k].buf[0] = malloc(INGEST_MAX_FILE + 1);
+    in->slots[k].buf[1] = malloc(INGEST_MAX_FILE + 1);
+  }
+  in->parse = malloc(depth * sizeof(size_t));
+
+  in->backend = INGEST_THREADS;
+  if (!in->sorted) {
+    pthread_create(&in->threads[in->num_threads++], NULL, list_thread, in);
+  }
+  if (!(flags & INGEST_THREADS)) {
+    // six operations per slot at most: two files, each an open, a read
+    // and a close; an empty (-1) direct descriptor for each file
+    int *files = malloc(2 * depth * sizeof(int));
+    memset(files, -1, 2 * depth * sizeof(int));
+    if (ring_setup(&in->ring, 8 * depth, files, 2 * depth)) {
+      in->backend = INGEST_URING;
+      pthread_create(&in->threads[in->num_threads++], NULL, ring_thread, in);
+    }
+    free(files);
+  }
+  for (int k = 0; k < threads; k++) {
+    pthread_create(&in->threads[in->num_threads++], NULL,
+      in->backend == INGEST_URING ? parse_worker : read_worker, in);
+  }
+  return in;
+}
+
+const char *ingest_backend(const ingest_t *in) {
+  return in->backend == INGEST_URING ? "io_uring" : "threads";
+}
+
+/**
+ * @brief How many keys there are, or have been listed so far when unsorted.
+ */
+size_t ingest_count(ingest_t *in) {
+  pthread_mutex_lock(&in->lock);
+  size_t count = in->count;
+  pthread_mutex_unlock(&in->lock);
+  return count;
+}
+
+/**
+ * @brief The next key, waiting for it if need be.  The key before it is
+ *   given back.
+ *
+ * @return the key, NULL after the last one.
+ */
+ingest_item_t *ingest_next(ingest_t *in) {
+  pthread_mutex_lock(&in->lock);
+  size_t i = in->next_out;
+  ingest_slot_t *s = &in->slots[i % in->depth];
+
+  while (i >= in->count || s->state != SLOT_READY || s->item.index != i) {
+    if (i >= in->count && in->listed) {
+      pthread_mutex_unlock(&in->lock);
+      return NULL;
+    }
+    pthread_cond_wait(&in->ready, &in->lock);
+  }
+  in->next_out++;
+
+  // Readers blocked on a full window are woken once it is half empty,
+  // not on every key, so they refill it in a batch.
+  if (in->next_read - in->next_out <= (size_t)in->depth / 2) {
+    pthread_cond_broadcast(&in->work);
+  }
+  pthread_mutex_unlock(&in->lock);
+  return &s->item;
+}
+
+void ingest_stats(ingest_t *in, ingest_stats_t *stats) {
+  pthread_mutex_lock(&in->lock);
+  *stats = in->stats;
+  pthread_mutex_unlock(&in->lock);
+}
+
+/**
+ * @brief Stop reading, wait for the threads and free everything,
+ *   including the keys handed out.
+ */
+void ingest_close(ingest_t *in) {
+  pthread_mutex_lock(&in->lock);
+  in->stop = 1;
+  pthread_cond_broadcast(&in->work);
+  pthread_mutex_unlock(&in->lock);
+  for (int k = 0; k < in->num_threads; k++) {
+    pthread_join(in->threads[k], NULL);
+  }
+
+  if (in->backend == INGEST_URING) {
+    ring_free(&in->ring);
+  }
+  for (int k = 0; k < in->depth; k++) {
+    rsa_keys_t *keys = &in->slots[k].item.keys;
+    mpz_clears(keys->p, keys->q, keys->n, keys->d, keys->e, NULL);
+    free(in->slots[k].buf[0]);
+    free(in->slots[k].buf[1]);
+  }
+  free(in->names);
+  free(in->arena);
+  free(in->slots);
+  free(in->parse);
+  close(in->dirfd);
+  pthread_mutex_destroy(&in->lock);
+  pthread_cond_destroy(&in->work);
+  pthread_cond_destroy(&in->ready);
+  free(in);
+}
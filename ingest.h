@@ -0,0 +1,56 @@
+/**
+ * @file ingest.h
+ * @brief Header for ingest.c, batched loading of a directory of key and
+ *   ciphertext files (keys/ or a gen-corpus -o directory) ahead of the
+ *   code that factors them.
+ * @version 0.1
+ * @date 2021-06-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef _INGEST_H
+#define _INGEST_H
+
+#include <stdint.h>
+#include <gmp.h>
+
+#include "rsa.h"
+
+#define INGEST_DEPTH 64        // keys read ahead of the consumer
+#define INGEST_MAX_FILE 16384  // largest key or ciphertext file
+#define INGEST_NAME_LEN 64
+
+// ingest_open flags: how the files are read, and in what order
+#define INGEST_URING 0    // io_uring, falls back to INGEST_THREADS without it
+#define INGEST_THREADS 1  // blocking open/read/close on the worker threads
+#define INGEST_UNSORTED 2 // directory order, reading starts before the listing ends
+
+// One key of the directory: public-<name>.txt and encrypted-<name>.dat.
+// It belongs to the ingest and stays valid until the next ingest_next.
+typedef struct {
+  char name[INGEST_NAME_LEN]; // "64" for public-64.txt, "64-17" for public-64-17.txt
+  size_t index;               // position in the order ingest_next hands keys out
+  rsa_keys_t keys;            // n and e read, the rest initialized
+  char *encrypted;            // the ciphertext, NULL without encrypted-<name>.dat
+  int enc_len;
+} ingest_item_t;
+
+typedef struct {
+  size_t keys;         // keys made ready so far
+  size_t files;        // files read
+  size_t bytes;
+  uint64_t first_usec; // ingest_open to the first key being ready
+  uint64_t usec;       // ingest_open to the last key being ready
+} ingest_stats_t;
+
+typedef struct ingest ingest_t;
+
+ingest_t *ingest_open(const char *dir, int threads, int depth, int flags);
+const char *ingest_backend(const ingest_t *in);
+size_t ingest_count(ingest_t *in);
+ingest_item_t *ingest_next(ingest_t *in);
+void ingest_stats(ingest_t *in, ingest_stats_t *stats);
+void ingest_close(ingest_t *in);
+
+#endif
@@ -0,0 +1,132 @@
+/**
+ * @file key-index.c
+ * @brief Add key directories (keys/ or gen-corpus -o directories, public
+ *   keys in the rsa_read_public_keys format) to a persistent shared-factor
+ *   index, -b keys per batch, and write the private key of every key that
+ *   shares a prime with any key indexed so far as private-<name>.txt.
+ *   Prints the latency of each batch.
+ *
+ *   Usage: key-index [-o outdir] [-b batch] [-t threads] index_dir keydir...
+ *
+ *   Private keys go to index_dir without -o.
+ * @version 0.1
+ * @date 2021-06-03
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "rsa.h"
+#include "ingest.h"
+#include "keyindex.h"
+
+typedef struct {
+	rsa_keys_t *keys;
+	char **names;
+	size_t count;
+	size_t capacity;
+} batch_t;
+
+/**
+ * @brief Write a recovered private key next to the others.
+ */
+void write_private(rsa_keys_t *keys, const char *name, void *arg)
+{
+	char fname[1024];
+	if (snprintf(fname, sizeof(fname), "%s/private-%s.txt", (const char *)arg, name) >= (int)sizeof(fname)) {
+		printf("Error - private key path for %s is too long\n", name);
+		exit(-1);
+	}
+	rsa_write_private_keys(keys, fname);
+	printf("  factored %s\n", name);
+}
+
+/**
+ * @brief Hand the batch to the index and report it.
+ */
+void flush(keyindex_t *ix, batch_t *batch, const char *outdir, int *number)
+{
+	keyindex_batch_t stats;
+	if (batch->count == 0) {
+		return;
+	}
+
+	keyindex_add(ix, batch->keys, batch->names, batch->count, write_private, (void *)outdir, &stats);
+	printf("batch %d: %zu keys, %zu new, %zu duplicate, %zu sharing a prime, %zu factored, "
+		"%d segments, %.3f ms\n", ++*number, stats.keys, stats.added, stats.duplicates,
+		stats.shared, stats.factored, stats.segments, stats.usec / 1e3);
+
+	for (size_t i = 0; i < batch->count; i++) {
+		mpz_clears(batch->keys[i].n, batch->keys[i].e, NULL);
+		free(batch->names[i]);
+	}
+	batch->count = 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *outdir = NULL;
+	size_t batch_size = 0;
+	int threads = 2;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "o:b:t:")) != -1) {
+		switch (opt) {
+		case 'o': outdir = optarg; break;
+		case 'b': batch_size = strtoul(optarg, NULL, 10); break;
+		case 't': threads = atoi(optarg); break;
+		default: argc = 0;
+		}
+	}
+	if (argc - optind < 2) {
+		printf("Usage: %s [-o outdir] [-b batch] [-t threads] index_dir keydir...\n", argv[0]);
+		exit(-1);
+	}
+	const char *index_dir = argv[optind];
+	if (outdir == NULL) outdir = index_dir;
+
+	keyindex_t *ix = keyindex_open(index_dir);
+	printf("%s: %zu keys in %d segments\n", index_dir, keyindex_count(ix), keyindex_segments(ix));
+
+	batch_t batch = {0};
+	int number = 0;
+	for (int d = optind + 1; d < argc; d++) {
+		// a batch per directory without -b
+		ingest_t *in = ingest_open(argv[d], threads, INGEST_DEPTH, INGEST_URING);
+		ingest_item_t *item;
+		while ((item = ingest_next(in)) != NULL) {
+			if (batch.count == batch.capacity) {
+				batch.capacity = batch.capacity ? 2 * batch.capacity : 1024;
+				batch.keys = realloc(batch.keys, batch.capacity * sizeof(rsa_keys_t));
+				batch.names = realloc(batch.names, batch.capacity * sizeof(char *));
+			}
+			rsa_keys_t *keys = &batch.keys[batch.count];
+			keys->num_bits = item->keys.num_bits;
+			keys->enc_block_size = item->keys.enc_block_size;
+			keys->dec_block_size = item->keys.dec_block_size;
+			mpz_init_set(keys->n, item->keys.n);
+			mpz_init_set(keys->e, item->keys.e);
+			batch.names[batch.count++] = strdup(item->name);
+			if (batch_size > 0 && batch.count == batch_size) {
+				flush(ix, &batch, outdir, &number);
+			}
+		}
+		ingest_close(in);
+		if (batch_size == 0) {
+			flush(ix, &batch, outdir, &number);
+		}
+	}
+	flush(ix, &batch, outdir, &number);
+
+	printf("%s: %zu keys in %d segments\n", index_dir, keyindex_count(ix), keyindex_segments(ix));
+	keyindex_close(ix);
+	free(batch.keys);
+	free(batch.names);
+	return 0;
+}
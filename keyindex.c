@@ -0,0 +1,644 @@
+/**
+ * @file keyindex.c
+ * @brief Incremental shared-factor index.  Every key added is kept, in
+ *   arrival order, in a few segments whose sizes at least double from the
+ *   newest to the oldest, so there are O(log n) of them.  Each segment
+ *   caches its product tree above chunks of KEYINDEX_CHUNK keys.
+ *
+ *   A batch of m new keys with product P is checked in one pass:
+ *   Y = prod(P_S mod P) mod P over the segment products P_S, then a
+ *   remainder tree of P * Y down the batch's own product tree, where
+ *   (P * Y mod n_i^2) / n_i shares a prime with n_i exactly when n_i
+ *   shares one with another key of the batch or of the history.  That is
+ *   one division per segment plus work quasi-linear in m.  Only the keys
+ *   it flags descend the batch's tree and the cached trees to find their
+ *   partners, and gcd(n_i, n_j) then factors both.
+ *
+ *   The batch's tree becomes the newest segment, and segments merge
+ *   while the older one is less than twice the newer one.
+ * @version 0.1
+ * @date 2021-06-03
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "keyindex.h"
+
+#define MANIFEST_HEADER "KEY INDEX"
+#define PATH_LEN 1024
+
+typedef struct {
+  char name[KEYINDEX_NAME_LEN];
+  unsigned int num_bits;
+  unsigned int enc_block_size;
+  unsigned int dec_block_size;
+  mpz_t n;
+  mpz_t e;
+  int factored;     // private key already handed to found
+} ix_key_t;
+
+typedef struct {
+  size_t first;     // keys first .. first + count - 1
+  size_t count;
+  int levels;       // tree[0] the chunk products, tree[levels - 1][0] the product of all
+  size_t width[KEYINDEX_MAX_LEVELS];
+  mpz_t *tree[KEYINDEX_MAX_LEVELS];
+  mpz_t rem;        // the segment product mod the product of the batch being checked
+} ix_segment_t;
+
+struct keyindex {
+  char dir[PATH_LEN];
+  ix_key_t *keys;
+  size_t count;
+  size_t capacity;
+  ix_segment_t segments[KEYINDEX_MAX_SEGMENTS];
+  int num_segments;
+  size_t *slots;    // open addressing on n: key number + 1, 0 for empty
+  size_t num_slots;
+};
+
+static uint64_t key_hash(const mpz_t n) {
+  uint64_t h = (mpz_getlimbn(n, 0) ^ ((uint64_t)mpz_size(n) << 56)) * 0x9E3779B97F4A7C15ULL;
+  return h ^ (h >> 29);
+}
+
+static long hash_find(const keyindex_t *ix, const mpz_t n) {
+  if (ix->num_slots == 0) {
+    return -1;
+  }
+  size_t mask = ix->num_slots - 1;
+  for (size_t s = key_hash(n) & mask; ix->slots[s]; s = (s + 1) & mask) {
+    if (mpz_cmp(ix->keys[ix->slots[s] - 1].n, n) == 0) return ix->slots[s] - 1;
+  }
+  return -1;
+}
+
+static void hash_put(keyindex_t *ix, size_t k) {
+  size_t mask = ix->num_slots - 1;
+  size_t s = key_hash(ix->keys[k].n) & mask;
+  while (ix->slots[s]) s = (s + 1) & mask;
+  ix->slots[s] = k + 1;
+}
+
+/**
+ * @brief Make room in the hash for keys keys, at most half full.
+ */
+static void hash_grow(keyindex_t *ix, size_t keys) {
+  if (keys * 2 <= ix->num_slots) {
+    return;
+  }
+  size_t size = ix->num_slots ? ix->num_slots : 1024;
+  while (keys * 2 > size) size *= 2;
+  free(ix->slots);
+  ix->slots = calloc(size, sizeof(size_t));
+  ix->num_slots = size;
+  for (size_t k = 0; k < ix->count; k++) {
+    hash_put(ix, k);
+  }
+}
+
+static ix_key_t *key_push(keyindex_t *ix) {
+  if (ix->count == ix->capacity) {
+    ix->capacity = ix->capacity ? 2 * ix->capacity : 1024;
+    ix->keys = realloc(ix->keys, ix->capacity * sizeof(ix_key_t));
+  }
+  ix_key_t *key = &ix->keys[ix->count++];
+  memset(key, 0, sizeof(*key));
+  mpz_inits(key->n, key->e, NULL);
+  return key;
+}
+
+/**
+ * @brief Build a product tree over tree[0]: node k of level l + 1 is the
+ *   product of nodes 2k and 2k + 1 of level l, or a copy of 2k when it is
+ *   the last.  Node k of level l covers leaves k 2^l .. (k + 1) 2^l - 1.
+ *
+ * @return number of levels.
+ */
+static int tree_build(mpz_t **tree, size_t *width) {
+  int l = 0;
+  while (width[l] > 1) {
+    width[l + 1] = (width[l] + 1) / 2;
+    tree[l + 1] = malloc(width[l + 1] * sizeof(mpz_t));
+    for (size_t k = 0; k < width[l + 1]; k++) {
+      mpz_init(tree[l + 1][k]);
+      if (2 * k + 1 < width[l]) {
+        mpz_mul(tree[l + 1][k], tree[l][2 * k], tree[l][2 * k + 1]);
+      } else {
+        mpz_set(tree[l + 1][k], tree[l][2 * k]);
+      }
+    }
+    l++;
+  }
+  return l + 1;
+}
+
+static void tree_clear(mpz_t **tree, const size_t *width, int from, int levels) {
+  for (int l = from; l < levels; l++) {
+    for (size_t k = 0; k < width[l]; k++) {
+      mpz_clear(tree[l][k]);
+    }
+    free(tree[l]);
+  }
+}
+
+/**
+ * @brief fname = dir/name, exiting rather than truncating past PATH_LEN.
+ */
+static void index_path(const char *dir, const char *name, char *fname) {
+  if (snprintf(fname, PATH_LEN, "%s/%s", dir, name) >= PATH_LEN) {
+    printf("Error - index path %s/%s is too long\n", dir, name);
+    exit(-1);
+  }
+}
+
+static void segment_path(const keyindex_t *ix, const ix_segment_t *s, char *fname) {
+  char name[64];
+  snprintf(name, sizeof(name), "tree-%zu-%zu.dat", s->first, s->count);
+  index_path(ix->dir, name, fname);
+}
+
+/**
+ * @brief The chunk products of a segment and the tree above them.
+ */
+static void segment_build(keyindex_t *ix, ix_segment_t *s) {
+  s->width[0] = (s->count + KEYINDEX_CHUNK - 1) / KEYINDEX_CHUNK;
+  s->tree[0] = malloc(s->width[0] * sizeof(mpz_t));
+  for (size_t c = 0; c < s->width[0]; c++) {
+    mpz_init_set_ui(s->tree[0][c], 1);
+    for (size_t k = c * KEYINDEX_CHUNK; k < (c + 1) * KEYINDEX_CHUNK && k < s->count; k++) {
+      mpz_mul(s->tree[0][c], s->tree[0][c], ix->keys[s->first + k].n);
+    }
+  }
+  s->levels = tree_build(s->tree, s->width);
+}
+
+static void segment_save(keyindex_t *ix, const ix_segment_t *s) {
+  char fname[PATH_LEN];
+  segment_path(ix, s, fname);
+  FILE *fp = fopen(fname, "w");
+  if (fp == NULL) {
+    perror("could not write index tree");
+    exit(-1);
+  }
+  for (int l = 0; l < s->levels; l++) {
+    for (size_t k = 0; k < s->width[l]; k++) {
+      if (mpz_out_raw(fp, s->tree[l][k]) == 0) {
+        perror("could not write index tree");
+        exit(-1);
+      }
+    }
+  }
+  fclose(fp);
+}
+
+/**
+ * @brief Read a segment's cached tree, or rebuild and save it when the
+ *   file is missing or short.
+ */
+static void segment_load(keyindex_t *ix, ix_segment_t *s) {
+  char fname[PATH_LEN];
+  int ok = 0;
+
+  segment_path(ix, s, fname);
+  FILE *fp = fopen(fname, "r");
+  if (fp != NULL) {
+    s->width[0] = (s->count + KEYINDEX_CHUNK - 1) / KEYINDEX_CHUNK;
+    s->levels = 1;
+    while (s->width[s->levels - 1] > 1) {
+      s->width[s->levels] = (s->width[s->levels - 1] + 1) / 2;
+      s->levels++;
+    }
+    ok = 1;
+    for (int l = 0; l < s->levels; l++) {
+      s->tree[l] = malloc(s->width[l] * sizeof(mpz_t));
+      for (size_t k = 0; k < s->width[l]; k++) {
+        mpz_init(s->tree[l][k]);
+        if (ok && mpz_inp_raw(s->tree[l][k], fp) == 0) ok = 0;
+      }
+    }
+    fclose(fp);
+    if (!ok) {
+      tree_clear(s->tree, s->width, 0, s->levels);
+    }
+  }
+  if (!ok) {
+    segment_build(ix, s);
+    segment_save(ix, s);
+  }
+}
+
+static void manifest_save(keyindex_t *ix) {
+  char fname[PATH_LEN], tmp[PATH_LEN];
+  index_path(ix->dir, "index.txt", fname);
+  index_path(ix->dir, "index.txt.tmp", tmp);
+
+  FILE *fp = fopen(tmp, "w");
+  if (fp == NULL) {
+    perror("could not write index");
+    exit(-1);
+  }
+  fprintf(fp, "%s\n", MANIFEST_HEADER);
+  fprintf(fp, "keys %zu\n", ix->count);
+  for (int s = 0; s < ix->num_segments; s++) {
+    fprintf(fp, "segment %zu %zu\n", ix->segments[s].first, ix->segments[s].count);
+  }
+  if (fclose(fp) != 0 || rename(tmp, fname) != 0) {
+    perror("could not write index");
+    exit(-1);
+  }
+}
+
+/**
+ * @brief Open an index directory, creating an empty index if there is
+ *   none.  Keys appended after the last complete batch are dropped.
+ */
+keyindex_t *keyindex_open(const char *dir) {
+  char fname[PATH_LEN], line[256];
+  size_t total = 0;
+
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    perror("could not create index directory");
+    exit(-1);
+  }
+  keyindex_t *ix = calloc(1, sizeof(keyindex_t));
+  if (snprintf(ix->dir, sizeof(ix->dir), "%s", dir) >= (int)sizeof(ix->dir)) {
+    printf("Error - index directory %s is too long\n", dir);
+    exit(-1);
+  }
+
+  index_path(dir, "index.txt", fname);
+  FILE *fp = fopen(fname, "r");
+  if (fp != NULL) {
+    if (fgets(line, sizeof(line), fp) == NULL || strncmp(line, MANIFEST_HEADER, strlen(MANIFEST_HEADER)) != 0 ||
+        fscanf(fp, " keys %zu", &total) != 1) {
+      printf("Error - %s is not a key index\n", fname);
+      exit(-1);
+    }
+    ix_segment_t *s = &ix->segments[0];
+    while (ix->num_segments < KEYINDEX_MAX_SEGMENTS && fscanf(fp, " segment %zu %zu", &s->first, &s->count) == 2) {
+      s = &ix->segments[++ix->num_segments];
+    }
+    fclose(fp);
+  }
+
+  index_path(dir, "keys.txt", fname);
+  fp = fopen(fname, "r");
+  if (fp == NULL && total > 0) {
+    perror("could not open index keys");
+    exit(-1);
+  }
+  hash_grow(ix, total);
+  for (size_t k = 0; k < total; k++) {
+    ix_key_t *key = key_push(ix);
+    if (fscanf(fp, "%63s %u %u %u", key->name, &key->num_bits, &key->enc_block_size, &key->dec_block_size) != 4 ||
+        mpz_inp_str(key->n, fp, 16) == 0 || mpz_inp_str(key->e, fp, 16) == 0) {
+      printf("Error - %s holds %zu of %zu keys\n", fname, k, total);
+      exit(-1);
+    }
+    hash_put(ix, k);
+  }
+  if (fp != NULL) {
+    // past the newline of the last key
+    int c;
+    while (total > 0 && (c = fgetc(fp)) != EOF && c != '\n') {
+    }
+    long end = ftell(fp);
+    fclose(fp);
+    if (truncate(fname, end) != 0) {
+      perror("could not open index keys");
+      exit(-1);
+    }
+  }
+
+  for (int s = 0; s < ix->num_segments; s++) {
+    ix_segment_t *seg = &ix->segments[s];
+    if (seg->first + seg->count > total) {
+      printf("Error - index segment %zu-%zu is past the last key\n", seg->first, seg->count);
+      exit(-1);
+    }
+    mpz_init(seg->rem);
+    segment_load(ix, seg);
+  }
+  return ix;
+}
+
+size_t keyindex_count(const keyindex_t *ix) {
+  return ix->count;
+}
+
+int keyindex_segments(const keyindex_t *ix) {
+  return ix->num_segments;
+}
+
+/**
+ * @brief Hand key k's private key to found, given a nontrivial factor.
+ */
+static void emit(keyindex_t *ix, size_t k, const mpz_t g, keyindex_found_t found, void *arg,
+                 keyindex_batch_t *stats) {
+  ix_key_t *key = &ix->keys[k];
+  if (key->factored || mpz_cmp_ui(g, 1) <= 0 || mpz_cmp(g, key->n) >= 0) {
+    return;
+  }
+  key->factored = 1;
+  stats->factored++;
+
+  rsa_keys_t keys;
+  mpz_t phi;
+  keys.num_bits = key->num_bits;
+  keys.enc_block_size = key->enc_block_size;
+  keys.dec_block_size = key->dec_block_size;
+  mpz_inits(keys.p, keys.q, keys.n, keys.d, keys.e, phi, NULL);
+  mpz_set(keys.n, key->n);
+  mpz_set(keys.e, key->e);
+  mpz_divexact(keys.q, key->n, g);
+  if (mpz_cmp(g, keys.q) < 0) {
+    mpz_set(keys.p, g);
+  } else {
+    mpz_set(keys.p, keys.q);
+    mpz_set(keys.q, g);
+  }
+
+  // d = e^-1 mod (p - 1)(q - 1), as find-key's compute_private_key
+  mpz_sub_ui(keys.d, keys.p, 1);
+  mpz_sub_ui(phi, keys.q, 1);
+  mpz_mul(phi, phi, keys.d);
+  if (!mpz_invert(keys.d, keys.e, phi)) {
+    mpz_set_ui(keys.d, 0);
+  }
+
+  if (found != NULL) {
+    found(&keys, key->name, arg);
+  }
+  mpz_clears(keys.p, keys.q, keys.n, keys.d, keys.e, phi, NULL);
+}
+
+static void factor_pair(keyindex_t *ix, size_t i, size_t j, keyindex_found_t found, void *arg,
+                        keyindex_batch_t *stats) {
+  mpz_t g;
+  mpz_init(g);
+  mpz_gcd(g, ix->keys[i].n, ix->keys[j].n);
+  emit(ix, i, g, found, arg, stats);
+  emit(ix, j, g, found, arg, stats);
+  mpz_clear(g);
+}
+
+/**
+ * @brief Find the keys of a segment sharing a prime with key i, down the
+ *   branches whose product does.
+ */
+static void segment_find(keyindex_t *ix, ix_segment_t *s, int level, size_t k, size_t i, mpz_t g,
+                         keyindex_found_t found, void *arg, keyindex_batch_t *stats) {
+  mpz_gcd(g, s->tree[level][k], ix->keys[i].n);
+  if (mpz_cmp_ui(g, 1) == 0) {
+    return;
+  }
+  if (level > 0) {
+    segment_find(ix, s, level - 1, 2 * k, i, g, found, arg, stats);
+    if (2 * k + 1 < s->width[level - 1]) {
+      segment_find(ix, s, level - 1, 2 * k + 1, i, g, found, arg, stats);
+    }
+    return;
+  }
+  for (size_t j = s->first + k * KEYINDEX_CHUNK; j < s->first + (k + 1) * KEYINDEX_CHUNK && j < s->first + s->count; j++) {
+    mpz_gcd(g, ix->keys[j].n, ix->keys[i].n);
+    if (mpz_cmp_ui(g, 1) != 0) {
+      factor_pair(ix, i, j, found, arg, stats);
+    }
+  }
+}
+
+/**
+ * @brief Find the batch keys under node k of the batch's tree that share
+ *   a prime with batch key i, the same way segment_find does.  The nodes
+ *   searched never cover i itself.
+ */
+static void batch_find(keyindex_t *ix, mpz_t **tree, const size_t *width, int level, size_t k,
+                       size_t base, size_t i, mpz_t g, keyindex_found_t found, void *arg,
+                       keyindex_batch_t *stats) {
+  mpz_gcd(g, tree[level][k], tree[0][i]);
+  if (mpz_cmp_ui(g, 1) == 0) {
+    return;
+  }
+  if (level > 0) {
+    batch_find(ix, tree, width, level - 1, 2 * k, base, i, g, found, arg, stats);
+    if (2 * k + 1 < width[level - 1]) {
+      batch_find(ix, tree, width, level - 1, 2 * k + 1, base, i, g, found, arg, stats);
+    }
+    return;
+  }
+  factor_pair(ix, base + i, base + k, found, arg, stats);
+}
+
+/**
+ * @brief Merge the two newest segments while the older is less than
+ *   twice the newer.
+ *
+ * @return number of stale tree files left in stale, to remove once the
+ *   manifest no longer names them.
+ */
+static int merge_segments(keyindex_t *ix, char (*stale)[PATH_LEN]) {
+  int num_stale = 0;
+  while (ix->num_segments >= 2) {
+    ix_segment_t *a = &ix->segments[ix->num_segments - 2];
+    ix_segment_t *b = &ix->segments[ix->num_segments - 1];
+    if (a->count >= 2 * b->count) {
+      break;
+    }
+    segment_path(ix, a, stale[num_stale++]);
+    segment_path(ix, b, stale[num_stale++]);
+    tree_clear(a->tree, a->width, 0, a->levels);
+    tree_clear(b->tree, b->width, 0, b->levels);
+    mpz_clear(b->rem);
+    a->count += b->count;
+    ix->num_segments--;
+    segment_build(ix, a);
+  }
+  return num_stale;
+}
+
+/**
+ * @brief Add a batch of public keys and recover the private key of every
+ *   key, new or old, that shares a prime with another.
+ *
+ * @param keys public keys, n, e and the sizes are read.
+ * @param names a name for each key, handed back to found.
+ * @param found called with each private key recovered, may be NULL.
+ * @param stats set to the batch's counts and latency.
+ */
+void keyindex_add(keyindex_t *ix, rsa_keys_t *keys, char **names, size_t count,
+                  keyindex_found_t found, void *arg, keyindex_batch_t *stats) {
+  struct timespec tick, tock;
+  clock_gettime(CLOCK_MONOTONIC, &tick);
+  memset(stats, 0, sizeof(*stats));
+  stats->keys = count;
+
+  // new keys go to the end, duplicates are dropped
+  size_t base = ix->count;
+  hash_grow(ix, ix->count + count);
+  for (size_t i = 0; i < count; i++) {
+    if (mpz_cmp_ui(keys[i].n, 1) <= 0 || hash_find(ix, keys[i].n) >= 0) {
+      stats->duplicates++;
+      continue;
+    }
+    ix_key_t *key = key_push(ix);
+    snprintf(key->name, sizeof(key->name), "%s", names[i]);
+    key->num_bits = keys[i].num_bits;
+    key->enc_block_size = keys[i].enc_block_size;
+    key->dec_block_size = keys[i].dec_block_size;
+    mpz_set(key->n, keys[i].n);
+    mpz_set(key->e, keys[i].e);
+    hash_put(ix, ix->count - 1);
+  }
+  size_t m = ix->count - base;
+  stats->added = m;
+  stats->segments = ix->num_segments;
+  if (m == 0) {
+    clock_gettime(CLOCK_MONOTONIC, &tock);
+    stats->usec = (tock.tv_sec - tick.tv_sec) * 1000000 + (tock.tv_nsec - tick.tv_nsec) / 1000;
+    return;
+  }
+
+  // product tree of the batch, down to the single keys
+  mpz_t *tree[KEYINDEX_MAX_LEVELS];
+  size_t width[KEYINDEX_MAX_LEVELS];
+  width[0] = m;
+  tree[0] = malloc(m * sizeof(mpz_t));
+  for (size_t i = 0; i < m; i++) {
+    mpz_init_set(tree[0][i], ix->keys[base + i].n);
+  }
+  int levels = tree_build(tree, width);
+  mpz_t *product = &tree[levels - 1][0];
+
+  // Y, every segment product mod the batch product, multiplied together
+  mpz_t y, t;
+  mpz_init_set_ui(y, 1);
+  mpz_init(t);
+  for (int s = 0; s < ix->num_segments; s++) {
+    mpz_mod(ix->segments[s].rem, ix->segments[s].tree[ix->segments[s].levels - 1][0], *product);
+    mpz_mul(y, y, ix->segments[s].rem);
+    mpz_mod(y, y, *product);
+  }
+
+  // remainder tree of P Y (below P^2 already) mod the squares of the nodes
+  mpz_t *rem = malloc(sizeof(mpz_t)), *next;
+  mpz_init(rem[0]);
+  mpz_mul(rem[0], *product, y);
+  for (int l = levels - 2; l >= 0; l--) {
+    next = malloc(width[l] * sizeof(mpz_t));
+    for (size_t k = 0; k < width[l]; k++) {
+      mpz_init(next[k]);
+      mpz_mul(t, tree[l][k], tree[l][k]);
+      mpz_mod(next[k], rem[k / 2], t);
+    }
+    for (size_t k = 0; k < width[l + 1]; k++) {
+      mpz_clear(rem[k]);
+    }
+    free(rem);
+    rem = next;
+  }
+
+  // (P Y mod n_i^2) / n_i = (P / n_i) Y mod n_i
+  for (size_t i = 0; i < m; i++) {
+    mpz_divexact(t, rem[i], tree[0][i]);
+    mpz_gcd(t, t, tree[0][i]);
+    if (mpz_cmp_ui(t, 1) == 0) {
+      continue;
+    }
+    stats->shared++;
+
+    // the rest of the batch hangs off the siblings of i's path to the root
+    for (int l = levels - 2; l >= 0; l--) {
+      size_t k = (i >> l) ^ 1;
+      if (k < width[l]) {
+        batch_find(ix, tree, width, l, k, base, i, t, found, arg, stats);
+      }
+    }
+    for (int s = 0; s < ix->num_segments; s++) {
+      ix_segment_t *seg = &ix->segments[s];
+      mpz_mod(t, seg->rem, tree[0][i]);
+      mpz_gcd(t, t, tree[0][i]);
+      if (mpz_cmp_ui(t, 1) != 0) {
+        segment_find(ix, seg, seg->levels - 1, 0, base + i, t, found, arg, stats);
+      }
+    }
+  }
+  for (size_t i = 0; i < m; i++) {
+    mpz_clear(rem[i]);
+  }
+  free(rem);
+  mpz_clears(y, t, NULL);
+
+  // the batch becomes the newest segment, keeping its tree from the chunks up
+  ix_segment_t *seg = &ix->segments[ix->num_segments++];
+  seg->first = base;
+  seg->count = m;
+  mpz_init(seg->rem);
+  if (levels > KEYINDEX_CHUNK_BITS) {
+    seg->levels = levels - KEYINDEX_CHUNK_BITS;
+    for (int l = 0; l < seg->levels; l++) {
+      seg->tree[l] = tree[l + KEYINDEX_CHUNK_BITS];
+      seg->width[l] = width[l + KEYINDEX_CHUNK_BITS];
+    }
+    tree_clear(tree, width, 0, KEYINDEX_CHUNK_BITS);
+  } else {
+    seg->levels = 1;
+    seg->width[0] = 1;
+    seg->tree[0] = malloc(sizeof(mpz_t));
+    mpz_init_set(seg->tree[0][0], *product);
+    tree_clear(tree, width, 0, levels);
+  }
+
+  char stale[2 * KEYINDEX_MAX_SEGMENTS][PATH_LEN];
+  int num_stale = merge_segments(ix, stale);
+
+  // keys, then the new tree, then the manifest that names them
+  char fname[PATH_LEN];
+  index_path(ix->dir, "keys.txt", fname);
+  FILE *fp = fopen(fname, "a");
+  if (fp == NULL) {
+    perror("could not write index keys");
+    exit(-1);
+  }
+  for (size_t k = base; k < ix->count; k++) {
+    ix_key_t *key = &ix->keys[k];
+    fprintf(fp, "%s %u %u %u ", key->name, key->num_bits, key->enc_block_size, key->dec_block_size);
+    mpz_out_str(fp, 16, key->n);
+    fprintf(fp, " ");
+    mpz_out_str(fp, 16, key->e);
+    fprintf(fp, "\n");
+  }
+  if (fclose(fp) != 0) {
+    perror("could not write index keys");
+    exit(-1);
+  }
+  segment_save(ix, &ix->segments[ix->num_segments - 1]);
+  manifest_save(ix);
+  for (int f = 0; f < num_stale; f++) {
+    unlink(stale[f]);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &tock);
+  stats->usec = (tock.tv_sec - tick.tv_sec) * 1000000 + (tock.tv_nsec - tick.tv_nsec) / 1000;
+}
+
+void keyindex_close(keyindex_t *ix) {
+  for (int s = 0; s < ix->num_segments; s++) {
+    tree_clear(ix->segments[s].tree, ix->segments[s].width, 0, ix->segments[s].levels);
+    mpz_clear(ix->segments[s].rem);
+  }
+  for (size_t k = 0; k < ix->count; k++) {
+    mpz_clears(ix->keys[k].n, ix->keys[k].e, NULL);
+  }
+  free(ix->keys);
+  free(ix->slots);
+  free(ix);
+}
@@ -0,0 +1,56 @@
+/**
+ * @file keyindex.h
+ * @brief Header for keyindex.c, a persistent index of public moduli that
+ *   checks each new batch of keys for primes shared with every key seen
+ *   before.
+ * @version 0.1
+ * @date 2021-06-03
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef _KEYINDEX_H
+#define _KEYINDEX_H
+
+#include <stdint.h>
+#include <gmp.h>
+
+#include "rsa.h"
+
+#define KEYINDEX_NAME_LEN 64
+#define KEYINDEX_CHUNK_BITS 6  // the cached trees stop at chunks of 64 keys
+#define KEYINDEX_CHUNK (1 << KEYINDEX_CHUNK_BITS)
+#define KEYINDEX_MAX_LEVELS 64
+#define KEYINDEX_MAX_SEGMENTS 64
+
+/*
+ * Index directory:
+ *
+ *   index.txt                 "KEY INDEX", "keys <count>", one "segment <first> <count>" per segment
+ *   keys.txt                  one "name num_bits enc_block_size dec_block_size n e" per key, hex
+ *   tree-<first>-<count>.dat  a segment's product tree above the chunks, mpz_out_raw
+ */
+
+typedef struct {
+  size_t keys;       // keys in the batch
+  size_t added;      // keys new to the index
+  size_t duplicates; // moduli already in the index or twice in the batch
+  size_t shared;     // new keys sharing a prime with another key
+  size_t factored;   // private keys recovered, older keys included
+  int segments;      // segments the batch was checked against
+  uint64_t usec;
+} keyindex_batch_t;
+
+// Called with the private key of every key that shares a prime
+typedef void (*keyindex_found_t)(rsa_keys_t *keys, const char *name, void *arg);
+
+typedef struct keyindex keyindex_t;
+
+keyindex_t *keyindex_open(const char *dir);
+size_t keyindex_count(const keyindex_t *ix);
+int keyindex_segments(const keyindex_t *ix);
+void keyindex_add(keyindex_t *ix, rsa_keys_t *keys, char **names, size_t count,
+                  keyindex_found_t found, void *arg, keyindex_batch_t *stats);
+void keyindex_close(keyindex_t *ix);
+
+#endif
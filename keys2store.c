@@ -0,0 +1,179 @@
+/**
+ * @file keys2store.c
+ * @brief Convert a directory of key files (keys/ by default), or a
+ *   gen-corpus packed file, into a binary key store.  Then reopen the
+ *   store and time loading, viewing and looking up every key.
+ *
+ *   Usage: keys2store store_file [key_dir]
+ *          keys2store -p packed_corpus store_file
+ * @version 0.1
+ * @date 2021-05-24
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "rsa.h"
+#include "keystore.h"
+
+struct timespec timer_start()
+{
+	struct timespec tick;
+	clock_gettime(CLOCK_MONOTONIC, &tick);
+	return tick;
+}
+
+uint64_t timer_end(struct timespec tick)
+{
+	struct timespec tock;
+	clock_gettime(CLOCK_MONOTONIC, &tock);
+	uint64_t start_nanos = tick.tv_sec * (long)1e9 + tick.tv_nsec;
+	uint64_t end_nanos = tock.tv_sec * (long)1e9 + tock.tv_nsec;
+
+	return (end_nanos - start_nanos) / 1000;
+}
+
+static int name_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @brief Add every public-*.txt in dir, using the matching private-*.txt
+ *   instead when there is one.
+ */
+long convert_dir(keystore_writer_t *w, const char *dir)
+{
+	DIR *dp = opendir(dir);
+	if (dp == NULL) {
+		perror("could not open key directory");
+		exit(-1);
+	}
+
+	char **names = NULL;
+	long num_names = 0;
+	struct dirent *ent;
+	while ((ent = readdir(dp)) != NULL) {
+		size_t len = strlen(ent->d_name);
+		if (strncmp(ent->d_name, "public-", 7) == 0 && len > 4 &&
+			strcmp(ent->d_name + len - 4, ".txt") == 0) {
+			names = realloc(names, (num_names + 1) * sizeof(char *));
+			names[num_names++] = strdup(ent->d_name);
+		}
+	}
+	closedir(dp);
+	qsort(names, num_names, sizeof(char *), name_cmp);
+
+	char fname[1024];
+	for (long i = 0; i < num_names; i++) {
+		rsa_keys_t keys;
+		int has_private;
+
+		snprintf(fname, sizeof(fname), "%s/private-%s", dir, names[i] + 7);
+		has_private = access(fname, R_OK) == 0;
+		if (has_private) {
+			rsa_read_private_keys(&keys, fname);
+		} else {
+			snprintf(fname, sizeof(fname), "%s/%s", dir, names[i]);
+			rsa_read_public_keys(&keys, fname);
+		}
+
+		keystore_add(w, &keys, has_private);
+		mpz_clears(keys.p, keys.q, keys.n, keys.d, keys.e, NULL);
+		free(names[i]);
+	}
+	free(names);
+
+	return num_names;
+}
+
+/**
+ * @brief Add every key of a gen-corpus packed file.
+ */
+long convert_packed(keystore_writer_t *w, const char *packed)
+{
+	FILE *fp = fopen(packed, "r");
+	if (fp == NULL) {
+		perror("could not open packed corpus");
+		exit(-1);
+	}
+
+	rsa_keys_t keys;
+	long count = 0;
+	while (rsa_fread_private_keys(&keys, fp)) {
+		keystore_add(w, &keys, 1);
+		mpz_clears(keys.p, keys.q, keys.n, keys.d, keys.e, NULL);
+		count++;
+
+		// skip the encrypted length and message lines
+		fscanf(fp, "%*d %*s ");
+	}
+	fclose(fp);
+
+	return count;
+}
+
+int main(int argc, char **argv)
+{
+	const char *packed = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "p:")) != -1) {
+		if (opt == 'p') {
+			packed = optarg;
+		} else {
+			argc = 0;
+		}
+	}
+	if (argc - optind < 1 || argc - optind > 2) {
+		printf("Usage: %s store_file [key_dir]\n"
+			"       %s -p packed_corpus store_file\n", argv[0], argv[0]);
+		exit(-1);
+	}
+	const char *store = argv[optind];
+	const char *dir = argc - optind == 2 ? argv[optind + 1] : "keys";
+
+	struct timespec t = timer_start();
+	keystore_writer_t *w = keystore_create(store);
+	long count = packed ? convert_packed(w, packed) : convert_dir(w, dir);
+	keystore_finish(w);
+	uint64_t write_usec = timer_end(t);
+	printf("Wrote %ld keys to %s in %.3f sec\n", count, store, write_usec / 1e6);
+
+	// open and touch every key, the way a factoring run would
+	t = timer_start();
+	keystore_t *ks = keystore_open(store);
+	size_t bits = 0;
+	for (size_t i = 0; i < keystore_count(ks); i++) {
+		keystore_key_t key;
+		keystore_view(ks, i, &key);
+		bits += mpz_sizeinbase(key.n, 2);
+	}
+	uint64_t load_usec = timer_end(t);
+	printf("Loaded %zu keys (%zu modulus bits) in %.3f sec\n",
+		keystore_count(ks), bits, load_usec / 1e6);
+
+	// every key must be found again by its modulus
+	t = timer_start();
+	for (size_t i = 0; i < keystore_count(ks); i++) {
+		keystore_key_t key;
+		keystore_view(ks, i, &key);
+		if (keystore_find(ks, key.n) != (long)i) {
+			printf("Error - key %zu not found by modulus\n", i);
+			exit(-1);
+		}
+	}
+	uint64_t find_usec = timer_end(t);
+	printf("Looked up %zu keys by modulus in %.3f sec\n",
+		keystore_count(ks), find_usec / 1e6);
+
+	keystore_close(ks);
+	return 0;
+}
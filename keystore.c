@@ -0,0 +1,284 @@
+/**
+ * @file keystore.c
+ * @brief Packed binary key store.  One file holds any number of keys
+ *   as fixed headers plus raw GMP limbs, so opening a store is a single
+ *   mmap and reading a key is mpz_roinit_n on the mapped limbs.  An
+ *   index sorted by a hash of n finds a key by modulus.
+ * @version 0.1
+ * @date 2021-05-24
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "keystore.h"
+
+struct keystore_writer {
+	FILE *fp;
+	uint64_t offset;           // where the next record goes
+	uint64_t count;
+	uint64_t capacity;
+	uint64_t *offsets;
+	keystore_index_t *index;
+};
+
+struct keystore {
+	const char *base;          // the mapping
+	size_t size;
+	const keystore_header_t *header;
+	const uint64_t *offsets;
+	const keystore_index_t *index;
+};
+
+/**
+ * @brief 64-bit hash of a modulus, over its limbs.
+ */
+uint64_t keystore_hash(const mpz_t n) {
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ mpz_size(n);
+	const mp_limb_t *limbs = mpz_limbs_read(n);
+
+	for (size_t i = 0; i < mpz_size(n); i++) {
+		// splitmix64 finalizer on each limb
+		uint64_t z = h + limbs[i] + 0x9e3779b97f4a7c15ULL;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		h = z ^ (z >> 31);
+	}
+	return h;
+}
+
+static int index_cmp(const void *a, const void *b) {
+	const keystore_index_t *x = a, *y = b;
+	if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+	return x->record < y->record ? -1 : x->record > y->record;
+}
+
+/**
+ * @brief Start writing a new key store.
+ */
+keystore_writer_t *keystore_create(const char *fname) {
+	keystore_writer_t *w = calloc(1, sizeof(keystore_writer_t));
+	keystore_header_t header = {0};
+
+	w->fp = fopen(fname, "w+b");
+	if (w->fp == NULL) {
+		perror("Error - could not write key store");
+		exit(-1);
+	}
+
+	// placeholder, keystore_finish fills in the real header
+	fwrite(&header, sizeof(header), 1, w->fp);
+	w->offset = sizeof(header);
+	return w;
+}
+
+/**
+ * @brief Append a key.  With has_private == 0 only n and e are stored,
+ *   like rsa_write_public_keys.
+ */
+void keystore_add(keystore_writer_t *w, rsa_keys_t *keys, int has_private) {
+	mpz_srcptr fields[5] = {keys->n, keys->e, keys->d, keys->p, keys->q};
+	keystore_record_t record = {0};
+
+	record.num_bits = keys->num_bits;
+	record.enc_block_size = keys->enc_block_size;
+	record.dec_block_size = keys->dec_block_size;
+	record.has_private = has_private;
+	for (int f = 0; f < (has_private ? 5 : 2); f++) {
+		record.limbs[f] = mpz_size(fields[f]);
+	}
+
+	if (w->count == w->capacity) {
+		w->capacity = w->capacity ? 2 * w->capacity : 1024;
+		w->offsets = realloc(w->offsets, w->capacity * sizeof(uint64_t));
+		w->index = realloc(w->index, w->capacity * sizeof(keystore_index_t));
+	}
+	w->offsets[w->count] = w->offset;
+	w->index[w->count].hash = keystore_hash(keys->n);
+	w->index[w->count].record = w->count;
+	w->count++;
+
+	fwrite(&record, sizeof(record), 1, w->fp);
+	w->offset += sizeof(record);
+	for (int f = 0; f < 5; f++) {
+		fwrite(mpz_limbs_read(fields[f]), sizeof(mp_limb_t), record.limbs[f], w->fp);
+		w->offset += record.limbs[f] * sizeof(mp_limb_t);
+	}
+}
+
+/**
+ * @brief Write the offsets table, the sorted index and the header, then
+ *   close the store and free the writer.
+ */
+void keystore_finish(keystore_writer_t *w) {
+	keystore_header_t header = {0};
+
+	memcpy(header.magic, KEYSTORE_MAGIC, sizeof(KEYSTORE_MAGIC));
+	header.count = w->count;
+	header.limb_bytes = sizeof(mp_limb_t);
+	header.offsets_offset = w->offset;
+	header.index_offset = w->offset + w->count * sizeof(uint64_t);
+
+	qsort(w->index, w->count, sizeof(keystore_index_t), index_cmp);
+	fwrite(w->offsets, sizeof(uint64_t), w->count, w->fp);
+	fwrite(w->index, sizeof(keystore_index_t), w->count, w->fp);
+
+	fseek(w->fp, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, w->fp);
+	if (fclose(w->fp) != 0) {
+		perror("Error - could not write key store");
+		exit(-1);
+	}
+
+	free(w->offsets);
+	free(w->index);
+	free(w);
+}
+
+/**
+ * @brief Whether count items of item_size bytes at offset fit in size
+ *   bytes, without overflowing, and start 8-byte aligned.
+ */
+static int range_ok(uint64_t offset, uint64_t count, uint64_t item_size, uint64_t size) {
+	return offset % 8 == 0 && offset <= size && count <= (size - offset) / item_size;
+}
+
+/**
+ * @brief Map a key store.  Both tables and every record's extent are
+ *   checked against the file size; nothing else is parsed until a key is
+ *   viewed.
+ */
+keystore_t *keystore_open(const char *fname) {
+	struct stat sbuf;
+	int fd = open(fname, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &sbuf) < 0) {
+		perror("Error - could not open key store");
+		exit(-1);
+	}
+	if ((size_t)sbuf.st_size < sizeof(keystore_header_t)) {
+		printf("Error - %s is not a key store\n", fname);
+		exit(-1);
+	}
+
+	keystore_t *ks = calloc(1, sizeof(keystore_t));
+	ks->size = sbuf.st_size;
+	ks->base = mmap(NULL, ks->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ks->base == MAP_FAILED) {
+		perror("Error - could not map key store");
+		exit(-1);
+	}
+
+	ks->header = (const keystore_header_t *)ks->base;
+	uint64_t count = ks->header->count;
+	if (memcmp(ks->header->magic, KEYSTORE_MAGIC, sizeof(KEYSTORE_MAGIC)) != 0 ||
+		ks->header->limb_bytes != sizeof(mp_limb_t) ||
+		!range_ok(ks->header->offsets_offset, count, sizeof(uint64_t), ks->size) ||
+		!range_ok(ks->header->index_offset, count, sizeof(keystore_index_t), ks->size)) {
+		printf("Error - %s is not a key store for this machine\n", fname);
+		exit(-1);
+	}
+	ks->offsets = (const uint64_t *)(ks->base + ks->header->offsets_offset);
+	ks->index = (const keystore_index_t *)(ks->base + ks->header->index_offset);
+
+	// each record's header and limbs, and each index entry's record number
+	for (uint64_t i = 0; i < count; i++) {
+		uint64_t offset = ks->offsets[i];
+		if (!range_ok(offset, 1, sizeof(keystore_record_t), ks->size) || ks->index[i].record >= count) {
+			printf("Error - %s is corrupt at record %lu\n", fname, (unsigned long)i);
+			exit(-1);
+		}
+		const keystore_record_t *record = (const keystore_record_t *)(ks->base + offset);
+		uint64_t limbs = 0;
+		for (int f = 0; f < 5; f++) {
+			limbs += record->limbs[f];
+		}
+		if (!range_ok(offset + sizeof(keystore_record_t), limbs, sizeof(mp_limb_t), ks->size)) {
+			printf("Error - %s is corrupt at record %lu\n", fname, (unsigned long)i);
+			exit(-1);
+		}
+	}
+
+	return ks;
+}
+
+size_t keystore_count(const keystore_t *ks) {
+	return ks->header->count;
+}
+
+/**
+ * @brief View key i in place, no limbs are copied.
+ */
+void keystore_view(const keystore_t *ks, size_t i, keystore_key_t *key) {
+	const keystore_record_t *record =
+		(const keystore_record_t *)(ks->base + ks->offsets[i]);
+	const mp_limb_t *limbs = (const mp_limb_t *)(record + 1);
+	mpz_ptr fields[5] = {key->n, key->e, key->d, key->p, key->q};
+
+	key->num_bits = record->num_bits;
+	key->enc_block_size = record->enc_block_size;
+	key->dec_block_size = record->dec_block_size;
+	key->has_private = record->has_private;
+
+	for (int f = 0; f < 5; f++) {
+		mpz_roinit_n(fields[f], limbs, record->limbs[f]);
+		limbs += record->limbs[f];
+	}
+}
+
+/**
+ * @brief Find a key by modulus.
+ *
+ * @return record number of the key, -1 if it isn't in the store.
+ */
+long keystore_find(const keystore_t *ks, const mpz_t n) {
+	uint64_t hash = keystore_hash(n);
+	size_t lo = 0, hi = ks->header->count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (ks->index[mid].hash < hash) lo = mid + 1;
+		else hi = mid;
+	}
+
+	// a hash can be shared, compare the moduli themselves
+	for (; lo < ks->header->count && ks->index[lo].hash == hash; lo++) {
+		keystore_key_t key;
+		keystore_view(ks, ks->index[lo].record, &key);
+		if (mpz_cmp(key.n, n) == 0) {
+			return ks->index[lo].record;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Copy key i into an rsa_keys_t, which owns its own mpz_t values
+ *   afterwards, the same as rsa_read_private_keys.
+ */
+void keystore_read_keys(const keystore_t *ks, size_t i, rsa_keys_t *keys) {
+	keystore_key_t key;
+	keystore_view(ks, i, &key);
+
+	keys->num_bits = key.num_bits;
+	keys->enc_block_size = key.enc_block_size;
+	keys->dec_block_size = key.dec_block_size;
+
+	mpz_init_set(keys->n, key.n);
+	mpz_init_set(keys->e, key.e);
+	mpz_init_set(keys->d, key.d);
+	mpz_init_set(keys->p, key.p);
+	mpz_init_set(keys->q, key.q);
+}
+
+void keystore_close(keystore_t *ks) {
+	munmap((void *)ks->base, ks->size);
+	free(ks);
+}
@@ -0,0 +1,84 @@
+/**
+ * @file keystore.h
+ * @brief Header for keystore.c, a packed binary key store that is
+ *   memory mapped and read without copying.
+ * @version 0.1
+ * @date 2021-05-24
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef _KEYSTORE_H
+#define _KEYSTORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <gmp.h>
+
+#include "rsa.h"
+
+#define KEYSTORE_MAGIC "RSAKS01"
+
+/*
+ * File layout, native byte order, every section 8-byte aligned:
+ *
+ *   keystore_header_t
+ *   records:  keystore_record_t, then the limbs of n, e, d, p, q
+ *   offsets:  uint64_t file offset of record i, in insertion order
+ *   index:    keystore_index_t sorted by hash of n
+ */
+typedef struct {
+	char magic[8];
+	uint64_t count;          // number of records
+	uint64_t offsets_offset; // file offset of the offsets table
+	uint64_t index_offset;   // file offset of the index
+	uint32_t limb_bytes;     // sizeof(mp_limb_t) of the writer
+	uint32_t reserved[7];
+} keystore_header_t;
+
+typedef struct {
+	uint32_t num_bits;
+	uint32_t enc_block_size;
+	uint32_t dec_block_size;
+	uint32_t has_private;    // d, p and q are present
+	uint32_t limbs[5];       // limb counts of n, e, d, p, q
+	uint32_t pad;
+} keystore_record_t;
+
+typedef struct {
+	uint64_t hash;           // keystore_hash(n)
+	uint64_t record;         // record number
+} keystore_index_t;
+
+// A key viewed in place.  The mpz_t fields point into the mapping:
+// read them only, never modify or clear them.
+typedef struct {
+	unsigned int num_bits;
+	unsigned int enc_block_size;
+	unsigned int dec_block_size;
+	int has_private;
+
+	mpz_t n;
+	mpz_t e;
+	mpz_t d;
+	mpz_t p;
+	mpz_t q;
+} keystore_key_t;
+
+typedef struct keystore keystore_t;
+typedef struct keystore_writer keystore_writer_t;
+
+uint64_t keystore_hash(const mpz_t n);
+
+keystore_writer_t *keystore_create(const char *fname);
+void keystore_add(keystore_writer_t *w, rsa_keys_t *keys, int has_private);
+void keystore_finish(keystore_writer_t *w);
+
+keystore_t *keystore_open(const char *fname);
+size_t keystore_count(const keystore_t *ks);
+void keystore_view(const keystore_t *ks, size_t i, keystore_key_t *key);
+long keystore_find(const keystore_t *ks, const mpz_t n);
+void keystore_read_keys(const keystore_t *ks, size_t i, rsa_keys_t *keys);
+void keystore_close(keystore_t *ks);
+
+#endif
@@ -0,0 +1,462 @@
+/**
+ * @file montlane.c
+ * @brief Lane-parallel Montgomery arithmetic.  Each mont_vec_t holds
+ *   MONT_LANES numbers and every lane may have its own modulus, so the
+ *   same kernel serves batch encryption (one key, many blocks) and
+ *   batch factoring (many keys).  The hot loops are compiled for
+ *   AVX-512, AVX2 and plain x86-64 and picked at run time
+ *   (mont_select_kernel).
+ * @version 0.1
+ * @date 2021-05-20
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <string.h>
+
+#include "rsa.h"
+#include "montlane.h"
+
+#define WINDOW_BITS 4 // fixed window width for mont_powm
+
+/**
+ * @brief Number of 32-bit limbs needed for n, 0 if n is too large
+ *   (or even) for this engine.
+ */
+int mont_limbs_for(const mpz_t n) {
+  if (mpz_even_p(n)) {
+    return 0;
+  }
+  int limbs = (mpz_sizeinbase(n, 2) + 31) / 32;
+  return limbs > MONT_MAX_LIMBS ? 0 : limbs;
+}
+
+/**
+ * @brief Reset a context.  Every lane must be given a modulus with
+ *   mont_set_modulus before use; spare lanes can repeat lane 0.
+ */
+void mont_ctx_init(mont_ctx_t *ctx, int limbs) {
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->limbs = limbs;
+}
+
+/**
+ * @brief Install modulus n in one lane and precompute -n^-1 and R mod n.
+ */
+void mont_set_modulus(mont_ctx_t *ctx, int lane, const mpz_t n) {
+  mpz_t r;
+  mpz_init(r);
+
+  mont_set_lane(ctx, ctx->n, lane, n);
+
+  // Newton iteration, each step doubles the number of correct bits
+  uint32_t n0 = (uint32_t)ctx->n[0][lane];
+  uint32_t x = n0;
+  for (int i = 0; i < 4; i++) {
+    x *= 2 - n0 * x;
+  }
+  ctx->ninv[lane] = (uint32_t)-x;
+
+  mpz_set_ui(r, 1);
+  mpz_mul_2exp(r, r, 32 * ctx->limbs);
+  mpz_mod(r, r, n);
+  mont_set_lane(ctx, ctx->one, lane, r);
+
+  mpz_mul(r, r, r);
+  mpz_mod(r, r, n);
+  mont_set_lane(ctx, ctx->r2, lane, r);
+
+  mpz_clear(r);
+}
+
+/**
+ * @brief Store a (already reduced) value into one lane as is.
+ */
+void mont_set_lane(const mont_ctx_t *ctx, mont_vec_t r, int lane, const mpz_t a) {
+  uint32_t limbs[MONT_MAX_LIMBS] = {0};
+  size_t count;
+
+  mpz_export(limbs, &count, -1, sizeof(uint32_t), 0, 0, a);
+  for (int i = 0; i < ctx->limbs; i++) {
+    r[i][lane] = limbs[i];
+  }
+}
+
+/**
+ * @brief Read one lane back into an mpz_t as is.
+ */
+void mont_get_lane(const mont_ctx_t *ctx, mpz_t a, const mont_vec_t r, int lane) {
+  uint32_t limbs[MONT_MAX_LIMBS];
+
+  for (int i = 0; i < ctx->limbs; i++) {
+    limbs[i] = r[i][lane];
+  }
+  mpz_import(a, ctx->limbs, -1, sizeof(uint32_t), 0, 0, limbs);
+}
+
+// Position of byte i of a len byte native-order word, counted from the
+// least significant byte.  Same layout as mpz_import(..., endian 0, ...).
+static inline int byte_pos(int i, int len) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return len - 1 - i;
+#else
+  (void)len;
+  return i;
+#endif
+}
+
+/**
+ * @brief Store a len byte native-order word (an RSA block) into one lane.
+ *   len must fit in the lane, i.e. len <= 4 * limbs.
+ */
+void mont_set_bytes(const mont_ctx_t *ctx, mont_vec_t r, int lane, const char *buf, int len) {
+  for (int i = 0; i < ctx->limbs; i++) {
+    r[i][lane] = 0;
+  }
+  for (int i = 0; i < len; i++) {
+    int pos = byte_pos(i, len);
+    r[pos / 4][lane] |= (uint64_t)(unsigned char)buf[i] << (8 * (pos % 4));
+  }
+}
+
+/**
+ * @brief Write one lane out as a len byte native-order word.
+ */
+void mont_get_bytes(const mont_ctx_t *ctx, char *buf, int len, const mont_vec_t r, int lane) {
+  for (int i = 0; i < len; i++) {
+    int pos = byte_pos(i, len);
+    buf[i] = pos / 4 < ctx->limbs ? (char)(r[pos / 4][lane] >> (8 * (pos % 4))) : 0;
+  }
+}
+
+/**
+ * @brief Convert a into Montgomery form (a * R mod n) in one lane.
+ */
+void mont_to_lane(const mont_ctx_t *ctx, mont_vec_t r, int lane, const mpz_t a) {
+  mpz_t t, n;
+  mpz_inits(t, n, NULL);
+
+  mont_get_lane(ctx, n, ctx->n, lane);
+  mpz_mul_2exp(t, a, 32 * ctx->limbs);
+  mpz_mod(t, t, n);
+  mont_set_lane(ctx, r, lane, t);
+
+  mpz_clears(t, n, NULL);
+}
+
+void mont_copy(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t a) {
+  memcpy(r, a, ctx->limbs * sizeof(r[0]));
+}
+
+// A whole row of digits (one limb of every lane) as a GCC vector.  The
+// compiler maps it onto zmm/ymm/xmm registers depending on the clone.
+typedef uint64_t lanes_t
+  __attribute__((vector_size(MONT_LANES * sizeof(uint64_t)), aligned(8), may_alias));
+
+#define ROW(v, j) (*(lanes_t *)(v)[j])
+#define CROW(v, j) (*(const lanes_t *)(v)[j])
+#define MONT_INLINE static inline __attribute__((always_inline))
+
+// Subtract n from t (k + 1 digits) in the lanes where t >= n.
+MONT_INLINE void mont_final_sub(const mont_ctx_t *ctx, mont_vec_t r, lanes_t *t) {
+  const int k = ctx->limbs;
+  const lanes_t lo = (lanes_t){0} + 0xffffffffu;
+  lanes_t diff[MONT_MAX_LIMBS];
+  lanes_t borrow = {0};
+
+  for (int j = 0; j < k; j++) {
+    lanes_t s = t[j] - CROW(ctx->n, j) - borrow;
+    diff[j] = s & lo;
+    borrow = s >> 63;
+  }
+
+  lanes_t keep = (lanes_t)((t[k] != 0) | (borrow == 0));
+  for (int j = 0; j < k; j++) {
+    ROW(r, j) = (diff[j] & keep) | (t[j] & ~keep);
+  }
+}
+
+/**
+ * @brief Coarsely integrated operand scanning (CIOS) Montgomery product,
+ *   r = a * b / R mod n in every lane.  r may alias a or b.
+ */
+MONT_INLINE void mont_mul_body(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t a, const mont_vec_t b) {
+  const int k = ctx->limbs;
+  const lanes_t lo = (lanes_t){0} + 0xffffffffu;
+  const lanes_t ninv = *(const lanes_t *)ctx->ninv;
+  lanes_t t[MONT_MAX_LIMBS + 2];
+  lanes_t s, c, m;
+
+  for (int j = 0; j < k + 2; j++) {
+    t[j] = (lanes_t){0};
+  }
+
+  for (int i = 0; i < k; i++) {
+    // t += a * b[i]
+    lanes_t bi = CROW(b, i) & lo;
+    c = (lanes_t){0};
+    for (int j = 0; j < k; j++) {
+      s = t[j] + (CROW(a, j) & lo) * bi + c;
+      t[j] = s & lo;
+      c = s >> 32;
+    }
+    s = t[k] + c;
+    t[k] = s & lo;
+    t[k + 1] = s >> 32;
+
+    // t = (t + m * n) / 2^32, with m chosen so the low digit vanishes
+    m = ((t[0] & lo) * (ninv & lo)) & lo;
+    s = t[0] + m * (CROW(ctx->n, 0) & lo);
+    c = s >> 32;
+    for (int j = 1; j < k; j++) {
+      s = t[j] + m * (CROW(ctx->n, j) & lo) + c;
+      t[j - 1] = s & lo;
+      c = s >> 32;
+    }
+    s = t[k] + c;
+    t[k - 1] = s & lo;
+    t[k] = t[k + 1] + (s >> 32);
+  }
+
+  mont_final_sub(ctx, r, t);
+}
+
+/**
+ * @brief r = a + b mod n, inputs reduced.
+ */
+MONT_INLINE void mont_add_body(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t a, const mont_vec_t b) {
+  const int k = ctx->limbs;
+  const lanes_t lo = (lanes_t){0} + 0xffffffffu;
+  lanes_t t[MONT_MAX_LIMBS + 1];
+  lanes_t c = {0};
+
+  for (int j = 0; j < k; j++) {
+    lanes_t s = CROW(a, j) + CROW(b, j) + c;
+    t[j] = s & lo;
+    c = s >> 32;
+  }
+  t[k] = c;
+
+  mont_final_sub(ctx, r, t);
+}
+
+/**
+ * @brief r = a - b mod n, inputs reduced.
+ */
+MONT_INLINE void mont_sub_body(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t a, const mont_vec_t b) {
+  const int k = ctx->limbs;
+  const lanes_t lo = (lanes_t){0} + 0xffffffffu;
+  lanes_t t[MONT_MAX_LIMBS];
+  lanes_t borrow = {0};
+  lanes_t c = {0};
+
+  for (int j = 0; j < k; j++) {
+    lanes_t s = CROW(a, j) - CROW(b, j) - borrow;
+    t[j] = s & lo;
+    borrow = s >> 63;
+  }
+
+  // add n back in the lanes that went negative
+  for (int j = 0; j < k; j++) {
+    lanes_t s = t[j] + (CROW(ctx->n, j) & -borrow) + c;
+    ROW(r, j) = s & lo;
+    c = s >> 32;
+  }
+}
+
+// One copy of the kernels per instruction set, each compiled with its
+// own target so the lanes_t arithmetic uses that ISA's registers.
+#define MONT_VARIANT(isa, attr)                                                          \
+  attr static void mont_mul_##isa(const mont_ctx_t *ctx, mont_vec_t r,                   \
+                                  const mont_vec_t a, const mont_vec_t b) {              \
+    mont_mul_body(ctx, r, a, b);                                                         \
+  }                                                                                      \
+  attr static void mont_add_##isa(const mont_ctx_t *ctx, mont_vec_t r,                   \
+                                  const mont_vec_t a, const mont_vec_t b) {              \
+    mont_add_body(ctx, r, a, b);                                                         \
+  }                                                                                      \
+  attr static void mont_sub_##isa(const mont_ctx_t *ctx, mont_vec_t r,                   \
+                                  const mont_vec_t a, const mont_vec_t b) {              \
+    mont_sub_body(ctx, r, a, b);                                                         \
+  }
+
+typedef void (*mont_op_t)(const mont_ctx_t *, mont_vec_t, const mont_vec_t, const mont_vec_t);
+
+typedef struct {
+  const char *name;
+  const char *cpu;   // __builtin_cpu_supports feature, NULL for any CPU
+  mont_op_t mul, add, sub;
+} mont_kernel_t;
+
+MONT_VARIANT(generic, )
+#if defined(__x86_64__) && defined(__GNUC__)
+MONT_VARIANT(avx2, __attribute__((target("avx2"))))
+MONT_VARIANT(avx512f, __attribute__((target("avx512f"))))
+#endif
+
+// Fastest first, mont_select_kernel(NULL) takes the first the CPU has
+static const mont_kernel_t mont_kernels[] = {
+#if defined(__x86_64__) && defined(__GNUC__)
+  {"avx512f", "avx512f", mont_mul_avx512f, mont_add_avx512f, mont_sub_avx512f},
+  {"avx2", "avx2", mont_mul_avx2, mont_add_avx2, mont_sub_avx2},
+#endif
+  {"generic", NULL, mont_mul_generic, mont_add_generic, mont_sub_generic},
+};
+
+#define NUM_KERNELS (int)(sizeof(mont_kernels) / sizeof(mont_kernels[0]))
+
+static const mont_kernel_t *mont_kernel;
+
+static int kernel_supported(const mont_kernel_t *kernel) {
+#if defined(__x86_64__) && defined(__GNUC__)
+  if (kernel->cpu != NULL) {
+    __builtin_cpu_init();
+    // __builtin_cpu_supports wants a literal
+    if (strcmp(kernel->cpu, "avx512f") == 0) return __builtin_cpu_supports("avx512f");
+    if (strcmp(kernel->cpu, "avx2") == 0) return __builtin_cpu_supports("avx2");
+    return 0;
+  }
+#endif
+  return 1;
+}
+
+/**
+ * @brief Name of built-in kernel i (0 is the fastest), NULL past the
+ *   last one.  mont_select_kernel says whether this CPU can run it.
+ */
+const char *mont_kernel_name(int i) {
+  if (i < 0 || i >= NUM_KERNELS) {
+    return NULL;
+  }
+  return mont_kernels[i].name;
+}
+
+/**
+ * @brief Use the named kernel from now on, or the fastest one this CPU
+ *   supports when name is NULL.  Not thread safe, call it before any
+ *   lanes are in use.
+ *
+ * @return 1 on success, 0 if the kernel is unknown or unsupported (the
+ *   current kernel is kept).
+ */
+int mont_select_kernel(const char *name) {
+  for (int i = 0; i < NUM_KERNELS; i++) {
+    if ((name == NULL || strcmp(name, mont_kernels[i].name) == 0) &&
+        kernel_supported(&mont_kernels[i])) {
+      mont_kernel = &mont_kernels[i];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Name of the kernel in use.
+ */
+const char *mont_current_kernel(void) {
+  if (mont_kernel == NULL) {
+    mont_select_kernel(NULL);
+  }
+  return mont_kernel->name;
+}
+
+void mont_mul(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t a, const mont_vec_t b) {
+  if (mont_kernel == NULL) {
+    mont_select_kernel(NULL);
+  }
+  mont_kernel->mul(ctx, r, a, b);
+}
+
+void mont_add(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t a, const mont_vec_t b) {
+  if (mont_kernel == NULL) {
+    mont_select_kernel(NULL);
+  }
+  mont_kernel->add(ctx, r, a, b);
+}
+
+void mont_sub(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t a, const mont_vec_t b) {
+  if (mont_kernel == NULL) {
+    mont_select_kernel(NULL);
+  }
+  mont_kernel->sub(ctx, r, a, b);
+}
+
+/**
+ * @brief Enter Montgomery form in every lane: r = a * R mod n, a < n.
+ */
+void mont_enter(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t a) {
+  mont_mul(ctx, r, a, ctx->r2);
+}
+
+/**
+ * @brief Leave Montgomery form: r = a / R mod n.
+ */
+void mont_redc(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t a) {
+  mont_vec_t plain_one;
+  memset(plain_one, 0, ctx->limbs * sizeof(plain_one[0]));
+  for (int l = 0; l < MONT_LANES; l++) {
+    plain_one[0][l] = 1;
+  }
+  mont_mul(ctx, r, a, plain_one);
+}
+
+#if DEFAULT_E == 101
+// Addition chain for the public exponent, 1 2 3 6 12 24 25 50 100 101:
+// 's' squares the running power, 'm' multiplies the base back in.
+static const char default_e_chain[] = "smsssmssm";
+#endif
+
+/**
+ * @brief r = base^exp in every lane, with base and r in Montgomery form.
+ *   The exponent is shared by all lanes, so the window schedule (and
+ *   which table entry gets multiplied in) is the same for every lane.
+ */
+void mont_powm(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t base, const mpz_t exp) {
+  mont_vec_t acc;
+
+#if DEFAULT_E == 101
+  if (mpz_cmp_ui(exp, DEFAULT_E) == 0) {
+    mont_copy(ctx, acc, base);
+    for (const char *step = default_e_chain; *step; step++) {
+      mont_mul(ctx, acc, acc, *step == 'm' ? base : acc);
+    }
+    mont_copy(ctx, r, acc);
+    return;
+  }
+#endif
+
+  if (mpz_sgn(exp) == 0) {
+    mont_copy(ctx, r, ctx->one);
+    return;
+  }
+
+  // table[i] = base^i
+  mont_vec_t table[1 << WINDOW_BITS];
+  mont_copy(ctx, table[0], ctx->one);
+  for (int i = 1; i < (1 << WINDOW_BITS); i++) {
+    mont_mul(ctx, table[i], table[i - 1], base);
+  }
+
+  int bits = mpz_sizeinbase(exp, 2);
+  int windows = (bits + WINDOW_BITS - 1) / WINDOW_BITS;
+  mont_copy(ctx, acc, ctx->one);
+
+  // WINDOW_BITS squarings, then one multiply by the table entry
+  for (int w = windows - 1; w >= 0; w--) {
+    int digit = 0;
+    for (int b = WINDOW_BITS - 1; b >= 0; b--) {
+      digit = (digit << 1) | mpz_tstbit(exp, w * WINDOW_BITS + b);
+    }
+
+    int steps = digit ? WINDOW_BITS + 1 : WINDOW_BITS;
+    if (w == windows - 1) {
+      mont_copy(ctx, acc, table[digit]);
+      steps = 0;
+    }
+    for (int step = 0; step < steps; step++) {
+      mont_mul(ctx, acc, acc, step < WINDOW_BITS ? acc : table[digit]);
+    }
+  }
+
+  mont_copy(ctx, r, acc);
+}
@@ -0,0 +1,58 @@
+/**
+ * @file montlane.h
+ * @brief Lane-parallel Montgomery arithmetic.  Numbers are stored
+ *   structure-of-arrays (limb-major, lane-minor) so that every limb
+ *   operation is a straight loop over MONT_LANES values, which the
+ *   compiler turns into AVX2/AVX-512 code.  The kernel for each
+ *   instruction set is built in and one is picked at run time.
+ * @version 0.1
+ * @date 2021-05-20
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef _MONTLANE_H
+#define _MONTLANE_H
+
+#include <stdint.h>
+#include <gmp.h>
+
+#define MONT_LANES 16     // Values processed side by side
+#define MONT_MAX_LIMBS 16 // 32-bit limbs, so moduli up to 512 bits
+
+// One number per lane: v[limb][lane], little endian 32-bit digits.
+// Digits are kept in 64-bit slots so products and carries stay in
+// the same register width (vpmuludq).
+typedef uint64_t mont_vec_t[MONT_MAX_LIMBS][MONT_LANES];
+
+typedef struct {
+  int limbs;                     // limbs in use, R = 2^(32 * limbs)
+  mont_vec_t n;                  // modulus of each lane (must be odd)
+  mont_vec_t one;                // R mod n, i.e. 1 in Montgomery form
+  mont_vec_t r2;                 // R^2 mod n, for mont_enter
+  uint64_t ninv[MONT_LANES];     // -n^-1 mod 2^32
+} mont_ctx_t;
+
+int mont_limbs_for(const mpz_t n);
+void mont_ctx_init(mont_ctx_t *ctx, int limbs);
+void mont_set_modulus(mont_ctx_t *ctx, int lane, const mpz_t n);
+
+void mont_set_lane(const mont_ctx_t *ctx, mont_vec_t r, int lane, const mpz_t a);
+void mont_get_lane(const mont_ctx_t *ctx, mpz_t a, const mont_vec_t r, int lane);
+void mont_set_bytes(const mont_ctx_t *ctx, mont_vec_t r, int lane, const char *buf, int len);
+void mont_get_bytes(const mont_ctx_t *ctx, char *buf, int len, const mont_vec_t r, int lane);
+void mont_to_lane(const mont_ctx_t *ctx, mont_vec_t r, int lane, const mpz_t a);
+void mont_copy(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t a);
+void mont_enter(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t a);
+void mont_redc(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t a);
+
+const char *mont_kernel_name(int i);
+int mont_select_kernel(const char *name);
+const char *mont_current_kernel(void);
+
+void mont_mul(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t a, const mont_vec_t b);
+void mont_add(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t a, const mont_vec_t b);
+void mont_sub(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t a, const mont_vec_t b);
+void mont_powm(const mont_ctx_t *ctx, mont_vec_t r, const mont_vec_t base, const mpz_t exp);
+
+#endif
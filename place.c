@@ -0,0 +1,250 @@
+/**
+ * @file place.c
+ * @brief Where the factoring threads run.  The topology comes from sysfs
+ *   (cpuN/topology and nodeM/cpulist), cut down to the CPUs this process
+ *   may use.  Under "cores" worker i is pinned to every hardware thread of
+ *   one physical core, so workers never share a core; under "threads" it
+ *   is pinned to a single hardware thread and the second siblings are only
+ *   used once every core has a worker.  Both spread consecutive workers
+ *   over the NUMA nodes, and place_alloc puts a worker's state on its
+ *   node.  "none" leaves it all to the kernel, as before.
+ * @version 0.1
+ * @date 2021-06-02
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "place.h"
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+#define SYSFS_NODE "/sys/devices/system/node"
+#define MAX_NODES 64
+
+static const char *policy_names[PLACE_POLICIES] = {"none", "cores", "threads"};
+
+static place_topology_t topology;
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief The number in a sysfs file, -1 without it.
+ */
+static int read_int(const char *fname) {
+  int value = -1;
+  FILE *fp = fopen(fname, "r");
+  if (fp != NULL) {
+    if (fscanf(fp, "%d", &value) != 1) value = -1;
+    fclose(fp);
+  }
+  return value;
+}
+
+/**
+ * @brief Give every CPU of a sysfs list ("0-3,8-11") to a node.
+ */
+static void read_cpulist(const char *fname, int node, int *cpu_node) {
+  char list[4096];
+  FILE *fp = fopen(fname, "r");
+  if (fp == NULL) {
+    return;
+  }
+  if (fgets(list, sizeof(list), fp) != NULL) {
+    char *s = list;
+    while (*s >= '0' && *s <= '9') {
+      int first = strtol(s, &s, 10), last = first;
+      if (*s == '-') last = strtol(s + 1, &s, 10);
+      for (int c = first; c <= last && c < PLACE_MAX_CPUS; c++) cpu_node[c] = node;
+      if (*s == ',') s++;
+    }
+  }
+  fclose(fp);
+}
+
+// sibling first, then the position among the node's CPUs of that sibling, then node
+static int order_key[PLACE_MAX_CPUS];
+
+static int order_cmp(const void *a, const void *b) {
+  int x = order_key[*(const int *)a], y = order_key[*(const int *)b];
+  return (x > y) - (x < y);
+}
+
+static void discover(void) {
+  place_topology_t *t = &topology;
+  int cpu_node[PLACE_MAX_CPUS], core_package[PLACE_MAX_CPUS], core_id[PLACE_MAX_CPUS];
+  char fname[256];
+  cpu_set_t allowed;
+
+  memset(t, 0, sizeof(*t));
+  for (int c = 0; c < PLACE_MAX_CPUS; c++) cpu_node[c] = 0;
+  for (int node = 0; node < MAX_NODES; node++) {
+    snprintf(fname, sizeof(fname), SYSFS_NODE "/node%d/cpulist", node);
+    if (access(fname, R_OK) == 0) {
+      read_cpulist(fname, node, cpu_node);
+      t->num_nodes = node + 1;
+    }
+  }
+  if (t->num_nodes == 0) t->num_nodes = 1;
+
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    CPU_ZERO(&allowed);
+    for (int c = 0; c < sysconf(_SC_NPROCESSORS_ONLN) && c < PLACE_MAX_CPUS; c++) CPU_SET(c, &allowed);
+  }
+
+  for (int c = 0; c < PLACE_MAX_CPUS && c < CPU_SETSIZE; c++) {
+    if (!CPU_ISSET(c, &allowed)) {
+      continue;
+    }
+    place_cpu_t *cpu = &t->cpus[t->num_cpus++];
+    cpu->cpu = c;
+    cpu->node = cpu_node[c];
+    snprintf(fname, sizeof(fname), SYSFS_CPU "/cpu%d/topology/physical_package_id", c);
+    cpu->package = read_int(fname);
+    if (cpu->package < 0) cpu->package = 0;
+    snprintf(fname, sizeof(fname), SYSFS_CPU "/cpu%d/topology/core_id", c);
+    int id = read_int(fname);
+    if (id < 0) id = c; // no topology, every CPU its own core
+
+    // number the cores across packages, and the threads within a core
+    cpu->core = -1;
+    for (int k = 0; k < t->num_cores; k++) {
+      if (core_package[k] == cpu->package && core_id[k] == id) cpu->core = k;
+    }
+    if (cpu->core < 0) {
+      cpu->core = t->num_cores++;
+      core_package[cpu->core] = cpu->package;
+      core_id[cpu->core] = id;
+    }
+    for (int k = 0; k < t->num_cpus - 1; k++) {
+      if (t->cpus[k].core == cpu->core) cpu->sibling++;
+    }
+    if (cpu->package + 1 > t->num_packages) t->num_packages = cpu->package + 1;
+  }
+
+  // worker order: first siblings before second siblings, and within them
+  // the first CPU of every node, then the second of every node...
+  for (int i = 0; i < t->num_cpus; i++) {
+    int rank = 0;
+    for (int k = 0; k < i; k++) {
+      if (t->cpus[k].sibling == t->cpus[i].sibling && t->cpus[k].node == t->cpus[i].node) rank++;
+    }
+    order_key[i] = (t->cpus[i].sibling * PLACE_MAX_CPUS + rank) * MAX_NODES + t->cpus[i].node;
+    t->by_thread[i] = i;
+  }
+  qsort(t->by_thread, t->num_cpus, sizeof(int), order_cmp);
+  for (int i = 0; i < t->num_cores; i++) {
+    t->by_core[i] = t->by_thread[i]; // the first sibling of every core comes first
+  }
+}
+
+/**
+ * @brief The CPUs this process may run on, read once.  Entries of
+ *   by_core and by_thread index cpus.
+ */
+const place_topology_t *place_topology(void) {
+  pthread_once(&topology_once, discover);
+  return &topology;
+}
+
+/**
+ * @brief A policy by name, -1 for an unknown one.
+ */
+int place_policy(const char *name) {
+  for (int p = 0; p < PLACE_POLICIES; p++) {
+    if (strcmp(name, policy_names[p]) == 0) return p;
+  }
+  return -1;
+}
+
+const char *place_policy_name(int policy) {
+  return policy >= 0 && policy < PLACE_POLICIES ? policy_names[policy] : "none";
+}
+
+/**
+ * @brief Workers that fill the machine under a policy: one per core for
+ *   "cores", one per hardware thread otherwise.
+ */
+int place_workers(int policy) {
+  const place_topology_t *t = place_topology();
+  return policy == PLACE_CORES ? t->num_cores : t->num_cpus;
+}
+
+/**
+ * @brief The CPUs of a worker, 0 under "none".
+ */
+static int worker_cpus(int policy, int worker, cpu_set_t *set) {
+  const place_topology_t *t = place_topology();
+  CPU_ZERO(set);
+  if (worker < 0 || t->num_cpus == 0) {
+    return 0;
+  }
+  if (policy == PLACE_CORES) {
+    int core = t->cpus[t->by_core[worker % t->num_cores]].core;
+    for (int i = 0; i < t->num_cpus; i++) {
+      if (t->cpus[i].core == core) CPU_SET(t->cpus[i].cpu, set);
+    }
+    return t->by_core[worker % t->num_cores] + 1;
+  }
+  if (policy == PLACE_THREADS) {
+    int i = t->by_thread[worker % t->num_cpus];
+    CPU_SET(t->cpus[i].cpu, set);
+    return i + 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief The node a worker will run on, -1 under "none".
+ */
+int place_node(int policy, int worker) {
+  cpu_set_t set;
+  int i = worker_cpus(policy, worker, &set);
+  return i ? place_topology()->cpus[i - 1].node : -1;
+}
+
+/**
+ * @brief Pin the calling thread as worker number worker.
+ *
+ * @return Its node, -1 if it was left unpinned.
+ */
+int place_pin(int policy, int worker) {
+  cpu_set_t set;
+  int i = worker_cpus(policy, worker, &set);
+  if (i == 0 || pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+    return -1;
+  }
+  return place_topology()->cpus[i - 1].node;
+}
+
+/**
+ * @brief Zeroed memory for a worker's state, on its node where there is
+ *   more than one (-1 for anywhere).  Release with place_free.
+ */
+void *place_alloc(size_t size, int node) {
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    perror("could not allocate worker state");
+    exit(-1);
+  }
+  if (node >= 0 && node < MAX_NODES && place_topology()->num_nodes > 1) {
+    unsigned long mask = 1UL << node;
+    // preferred, not bound: a full node still gives memory from another
+    syscall(SYS_mbind, p, size, MPOL_PREFERRED, &mask, MAX_NODES + 1, 0);
+  }
+  return p;
+}
+
+void place_free(void *p, size_t size) {
+  if (p != NULL) {
+    munmap(p, size);
+  }
+}
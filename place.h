@@ -0,0 +1,51 @@
+/**
+ * @file place.h
+ * @brief Header for place.c, CPU topology and worker placement for the
+ *   factoring threads.
+ * @version 0.1
+ * @date 2021-06-02
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef _PLACE_H
+#define _PLACE_H
+
+#include <stddef.h>
+
+#define PLACE_MAX_CPUS 1024
+
+// Placement policies, "none", "cores" and "threads" in tune.txt
+#define PLACE_NONE 0    // wherever the kernel puts them
+#define PLACE_CORES 1   // worker i owns a whole physical core
+#define PLACE_THREADS 2 // worker i owns one hardware thread
+#define PLACE_POLICIES 3
+
+typedef struct {
+  int cpu;      // logical CPU number
+  int core;     // physical core, numbered across packages
+  int package;
+  int node;     // NUMA node, 0 without NUMA
+  int sibling;  // 0 for the first hardware thread of its core, then 1...
+} place_cpu_t;
+
+typedef struct {
+  int num_cpus;                      // CPUs this process may run on
+  int num_cores;
+  int num_packages;
+  int num_nodes;
+  place_cpu_t cpus[PLACE_MAX_CPUS];
+  int by_core[PLACE_MAX_CPUS];       // first thread of each core, nodes interleaved
+  int by_thread[PLACE_MAX_CPUS];     // every thread, first siblings first, nodes interleaved
+} place_topology_t;
+
+const place_topology_t *place_topology(void);
+int place_policy(const char *name);
+const char *place_policy_name(int policy);
+int place_workers(int policy);
+int place_node(int policy, int worker);
+int place_pin(int policy, int worker);
+void *place_alloc(size_t size, int node);
+void place_free(void *p, size_t size);
+
+#endif
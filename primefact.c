@@ -43,8 +43,34 @@ void modular_power_mpz(mpz_t result, mpz_t n, mpz_t c) {
  * @param n mpz_t number to find primes of.
  * @param thread_struct rsa_decrypt_t struct containing information 
  *   necessary to calculate prime and return information. 
+ * @return 1 if p was set, 0 if *found was set elsewhere first (another
+ *   thread won the race, or the caller wants it to stop).  Racing threads
+ *   claim *found atomically, so exactly one of them returns 1.
  */
-void pollardRho(mpz_t n, rsa_decrypt_t *thread_struct) { 
+int pollardRho(mpz_t n, rsa_decrypt_t *thread_struct) { 
+  // Return if has already been found
+  if(__atomic_load_n(thread_struct->found, __ATOMIC_ACQUIRE) == 1) { 
+    return 0;
+  }
+
+  // If n == 1, there is no prime divisor for 1.
+  if(!mpz_cmp_ui(n, 1)) {
+    if (__atomic_exchange_n(thread_struct->found, 1, __ATOMIC_ACQ_REL) != 0) {
+      return 0; // Another thread claimed it first
+    }
+    mpz_set(thread_struct->p, n); // Set p 
+    return 1; // Return, we've found our divisor
+  }  
+
+  // If n is even, we've found our divisor
+  if (mpz_even_p(n)) { 
+    if (__atomic_exchange_n(thread_struct->found, 1, __ATOMIC_ACQ_REL) != 0) {
+      return 0; // Another thread claimed it first
+    }
+    mpz_set_ui(thread_struct->p, 2); // Set p
+    return 1; // Return, we've found our divisor 
+  }
+
   // Create constant for 1 and 2 used in calculations 
   mpz_t TWO, ONE; 
   mpz_init(ONE);
@@ -52,14 +78,13 @@ void pollardRho(mpz_t n, rsa_decrypt_t *thread_struct) {
   mpz_set_ui(ONE, 1); 
   mpz_set_ui(TWO, 2); 
 
-  // Return if has already been found
-  if(*(thread_struct->found) == 1) { 
-    pthread_exit(NULL);
-  }
-
   // Need to initialize a randstate for mpz_urandomb
   gmp_randstate_t state; 
   gmp_randinit_mt(state); 
+  // Racing threads need different walks, thread 0 keeps the default
+  if (thread_struct->seed) {
+    gmp_randseed_ui(state, thread_struct->seed);
+  }
 
   // Create & Initialize random number 
   mpz_t rand_s; 
@@ -70,113 +95,65 @@ void pollardRho(mpz_t n, rsa_decrypt_t *thread_struct) {
   mpz_urandomb(rand_s, state, 128);
   mpz_clear(rand_s);
 
-  // If n == 1, there is no prime divisor for 1.
-  if(!mpz_cmp_ui(n, 1)) {
-    gmp_randclear(state);
-    mpz_clear(ONE);
-    mpz_clear(TWO);
-    *(thread_struct->found) = 1; // Set flag for found
-    mpz_set(thread_struct->p, n); // Set p 
-    return; // Return, we've found our divisor
-  }  
-
-  // Create mpz_t to store result of n % 2
-  mpz_t result_mod_2;
-  mpz_init(result_mod_2);
-  
-  // Calculate n % 2
-  mpz_mod_ui(result_mod_2, n, 2); 
-
-  // If n % 2 == 0, n is even, we've found our divisor
-  if (!mpz_cmp_ui(result_mod_2, 0)) { 
-    gmp_randclear(state);
-    mpz_clear(ONE);
-    mpz_clear(TWO);
-    mpz_clear(result_mod_2);
-    *(thread_struct->found) = 1; // Set flag for found 
-    mpz_set_ui(thread_struct->p, 2); // Set p
-    return; // Return, we've found our divisor 
-  }
-
-  mpz_clear(result_mod_2);
-
-  // Create & initialize variables to store randomly generated numbers
-  mpz_t rand1, rand2; 
-  mpz_init(rand1);
-  mpz_init(rand2); 
-
-  // Generate random numbers
-  mpz_urandomb(rand1, state, 128); 
-  mpz_urandomb(rand2, state, 128);
-
   // Create and initialize variables to perform calculations
-  mpz_t x, y, c, d, n_copy; 
-  mpz_init(x); 
-  mpz_init(y); 
-  mpz_init(d); // Just a variable name, albiet confusing 
-  mpz_init(c); 
-  mpz_init(n_copy); 
-
-  mpz_set(n_copy, n); // Create a copy of n so we can modify it for both calculations
-
-  // Calculate x, x picks from range [2, n)
-  mpz_sub(n_copy, n, TWO); // (n - 2)
-  mpz_mod(x, rand1, n_copy); // rand % n - 2
-  mpz_add(x, x, TWO); // (rand % n - 2) + 2
-  mpz_clear(rand1);
-
-  // Calculate y, which is a copy of x
-  mpz_set(y, x);
-
-  // Caclulate c 
-  mpz_sub(n_copy, n, ONE); // n - 1
-  mpz_mod(c, rand2, n_copy); // rand % n - 1
-  mpz_add(c, c, ONE); // rand % n - 1 + 1
-
-  mpz_clear(rand2);
-  mpz_clear(n_copy);
-
-  mpz_set(d, ONE); // Set d = 1
-
-  // While d == 1
-  while (!mpz_cmp_ui(d, 1)) { 
-    if(*(thread_struct->found) == 1) { 
-      pthread_exit(NULL);
+  mpz_t x, y, c, d, n_copy, rand1, rand2, abs; 
+  mpz_inits(x, y, c, d, n_copy, rand1, rand2, abs, NULL);
+  int found = 0;
+
+  // A walk ends when gcd(x - y, n) != 1.  When it is n, x and y met mod
+  // both primes at once: start a new walk from the same state, which
+  // unlike starting over gives a different x and c.
+  while (!found) {
+    // Generate random numbers
+    mpz_urandomb(rand1, state, 128); 
+    mpz_urandomb(rand2, state, 128);
+
+    // Calculate x, x picks from range [2, n)
+    mpz_sub(n_copy, n, TWO); // (n - 2)
+    mpz_mod(x, rand1, n_copy); // rand % n - 2
+    mpz_add(x, x, TWO); // (rand % n - 2) + 2
+
+    // Calculate y, which is a copy of x
+    mpz_set(y, x);
+
+    // Caclulate c 
+    mpz_sub(n_copy, n, ONE); // n - 1
+    mpz_mod(c, rand2, n_copy); // rand % n - 1
+    mpz_add(c, c, ONE); // rand % n - 1 + 1
+
+    mpz_set(d, ONE); // Set d = 1
+
+    // While d == 1
+    while (!mpz_cmp_ui(d, 1)) { 
+      if(__atomic_load_n(thread_struct->found, __ATOMIC_ACQUIRE) == 1) { 
+        break;
+      }
+      // "Tortise move"
+      modular_power_mpz(x, n, c);
+      // "Hare move"
+      modular_power_mpz(y, n, c); 
+      modular_power_mpz(y, n, c); 
+
+      mpz_sub(abs, x, y); // x - y
+      mpz_abs(abs, abs); // abs(x-y)
+      mpz_gcd(d, abs, n); //gcd(abs(x-y), n)
     }
-    // "Tortise move"
-    modular_power_mpz(x, n, c);
-    // "Hare move"
-    modular_power_mpz(y, n, c); 
-    modular_power_mpz(y, n, c); 
-
-    //mpz_clear(c);
-
-    mpz_t abs;
-    mpz_init(abs);
-    mpz_sub(abs, x, y); // x - y
-    mpz_abs(abs, abs); // abs(x-y)
-    mpz_gcd(d, abs, n); //gcd(abs(x-y), n)
-    mpz_clear(abs);
-
-    // If gcd(x-y,n) == n, call again
-    if(!mpz_cmp(d, n)) {
-      gmp_randclear(state);
-      mpz_clear(ONE);
-      mpz_clear(TWO);
-      mpz_clear(x);
-      mpz_clear(y);
-      mpz_clear(d);
-      return pollardRho(n, thread_struct);
+
+    if (!mpz_cmp_ui(d, 1)) {
+      break; // stopped from outside
     }
+    found = mpz_cmp(d, n) != 0;
   }
 
+  // d != 1, we found our p value, but only the first thread to claim
+  // the flag reports it
+  if (found && __atomic_exchange_n(thread_struct->found, 1, __ATOMIC_ACQ_REL) != 0) {
+    found = 0;
+  }
+  if (found) {
+    mpz_set(thread_struct->p, d); // Set p
+  }
   gmp_randclear(state);
-  // d != 1, we found our p value
-  *(thread_struct->found) = 1; // Set found flag
-  mpz_set(thread_struct->p, d); // Set p
-  mpz_clear(ONE);
-  mpz_clear(TWO);
-  mpz_clear(d);
-  mpz_clear(x);
-  mpz_clear(y);
+  mpz_clears(ONE, TWO, x, y, c, d, n_copy, rand1, rand2, abs, NULL);
+  return found;
 }
@@ -19,6 +19,6 @@
 #define RSA
 #include "rsa.h"
 
-void pollardRho(mpz_t n, rsa_decrypt_t *thread_struct);
+int pollardRho(mpz_t n, rsa_decrypt_t *thread_struct);
 void modular_power_mpz(mpz_t var, mpz_t n, mpz_t c);
 #endif
@@ -0,0 +1,173 @@
+/**
+ * @file rho-batch.c
+ * @brief Factor every key of a gen-corpus packed file with the
+ *   lane-parallel rho_batch engine, check the factors against the
+ *   private keys, and compare keys/hour with one pollardRho call per key
+ *   on compare_keys keys sampled evenly across the corpus.
+ *
+ *   Usage: rho-batch [-t threads] [-c compare_keys] packed_corpus
+ *
+ *   The worker count, gcd length and kernels come from tune.txt if there
+ *   is one.
+ * @version 0.1
+ * @date 2021-05-27
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "rsa.h"
+#include "primefact.h"
+#include "rhobatch.h"
+#include "tune.h"
+#include "montlane.h"
+#include "rho52.h"
+
+struct timespec timer_start()
+{
+	struct timespec tick;
+	clock_gettime(CLOCK_MONOTONIC, &tick);
+	return tick;
+}
+
+uint64_t timer_end(struct timespec tick)
+{
+	struct timespec tock;
+	clock_gettime(CLOCK_MONOTONIC, &tock);
+	uint64_t start_nanos = tick.tv_sec * (long)1e9 + tick.tv_nsec;
+	uint64_t end_nanos = tock.tv_sec * (long)1e9 + tock.tv_nsec;
+
+	return (end_nanos - start_nanos) / 1000;
+}
+
+/**
+ * @brief Read the moduli (and known factors) of a packed corpus.
+ */
+size_t read_corpus(const char *packed, mpz_t **n, mpz_t **p)
+{
+	FILE *fp = fopen(packed, "r");
+	if (fp == NULL) {
+		perror("could not open packed corpus");
+		exit(-1);
+	}
+
+	rsa_keys_t keys;
+	size_t count = 0, capacity = 0;
+	while (rsa_fread_private_keys(&keys, fp)) {
+		if (count == capacity) {
+			capacity = capacity ? 2 * capacity : 1024;
+			*n = realloc(*n, capacity * sizeof(mpz_t));
+			*p = realloc(*p, capacity * sizeof(mpz_t));
+		}
+		mpz_init_set((*n)[count], keys.n);
+		mpz_init_set((*p)[count], keys.p);
+		mpz_clears(keys.p, keys.q, keys.n, keys.d, keys.e, NULL);
+		count++;
+
+		// skip the encrypted length and message lines
+		fscanf(fp, "%*d %*s ");
+	}
+	fclose(fp);
+
+	return count;
+}
+
+int main(int argc, char **argv)
+{
+	tune_load(TUNE_PROFILE, &tune_profile);
+	tune_apply(&tune_profile);
+
+	int num_threads = tune_profile.batch_threads;
+	long compare = 20;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:c:")) != -1) {
+		switch (opt) {
+		case 't': num_threads = atoi(optarg); break;
+		case 'c': compare = atol(optarg); break;
+		default: argc = 0;
+		}
+	}
+	if (argc - optind != 1) {
+		printf("Usage: %s [-t threads] [-c compare_keys] packed_corpus\n", argv[0]);
+		exit(-1);
+	}
+
+	mpz_t *n = NULL, *known = NULL;
+	size_t count = read_corpus(argv[optind], &n, &known);
+	if (count == 0) {
+		printf("Error - no keys in %s\n", argv[optind]);
+		exit(-1);
+	}
+
+	mpz_t *p = malloc(count * sizeof(mpz_t));
+	for (size_t i = 0; i < count; i++) {
+		mpz_init(p[i]);
+	}
+
+	uint64_t iterations;
+	struct timespec t = timer_start();
+	long factored = rho_batch(n, p, count, num_threads, &iterations);
+	uint64_t batch_usec = timer_end(t);
+
+	// every factor must divide n and be one of the key's primes
+	for (size_t i = 0; i < count; i++) {
+		if (mpz_sgn(p[i]) == 0) {
+			continue;
+		}
+		mpz_t q;
+		mpz_init(q);
+		if (!mpz_divisible_p(n[i], p[i]) || mpz_cmp_ui(p[i], 1) == 0 ||
+			mpz_cmp(p[i], n[i]) == 0) {
+			gmp_printf("Error - %Zd is not a factor of %Zd\n", p[i], n[i]);
+			exit(-1);
+		}
+		mpz_divexact(q, n[i], p[i]);
+		if (mpz_cmp(p[i], known[i]) != 0 && mpz_cmp(q, known[i]) != 0) {
+			gmp_printf("Error - %Zd does not match the private key of %Zd\n", p[i], n[i]);
+			exit(-1);
+		}
+		mpz_clear(q);
+	}
+
+	printf("rho_batch:  %ld/%zu keys in %.3f sec, %.0f keys/hour, %.0f iterations/sec (%d threads, %s/%s kernels)\n",
+		factored, count, batch_usec / 1e6, factored * 3600e6 / (batch_usec ? batch_usec : 1),
+		iterations * 1e6 / (batch_usec ? batch_usec : 1), num_threads, mont_current_kernel(),
+		tune_use_rho52(&tune_profile) ? rho52_current_kernel() : "montlane");
+
+	// keys spread evenly over the corpus one at a time, the way find-key
+	// does it; gen-corpus writes the sizes in order, so a prefix would be
+	// only the smallest keys while rho_batch's rate covers all of them
+	if (compare > (long)count) compare = count;
+	if (compare > 0) {
+		int found = 0;
+		rsa_decrypt_t thread_struct = {0};
+		mpz_init(thread_struct.p);
+		thread_struct.found = &found;
+
+		t = timer_start();
+		for (long i = 0; i < compare; i++) {
+			found = 0;
+			pollardRho(n[i * count / compare], &thread_struct);
+		}
+		uint64_t single_usec = timer_end(t);
+		mpz_clear(thread_struct.p);
+
+		printf("pollardRho: %ld keys in %.3f sec, %.0f keys/hour (1 thread)\n",
+			compare, single_usec / 1e6, compare * 3600e6 / (single_usec ? single_usec : 1));
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		mpz_clears(n[i], p[i], known[i], NULL);
+	}
+	free(n);
+	free(p);
+	free(known);
+	return 0;
+}
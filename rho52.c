@@ -0,0 +1,258 @@
+/**
+ * @file rho52.c
+ * @brief Pollard Rho steps on radix 2^52 Montgomery numbers.  From
+ *   100 to 200 bits a modulus is 2-4 52-bit digits instead of 4-7
+ *   32-bit ones, and AVX-512 IFMA multiplies a row of 52-bit digits in
+ *   one instruction for each half of the product.  Values are reduced
+ *   lazily (kept below 3n) since n < R / 16 leaves enough headroom, and
+ *   the whole gcd block runs inside the kernel with the lanes held in
+ *   registers.  Without IFMA the same code runs with the 52-bit
+ *   products split into 26-bit halves.
+ * @version 0.1
+ * @date 2021-05-29
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <string.h>
+
+#include "rho52.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
+#define MASK52 ((1ULL << 52) - 1)
+#define MASK26 ((1ULL << 26) - 1)
+
+// Eight lanes of 52-bit digits, one zmm (or two ymm) register
+typedef uint64_t v8_t __attribute__((vector_size(8 * sizeof(uint64_t))));
+typedef int64_t sv8_t __attribute__((vector_size(8 * sizeof(int64_t))));
+typedef uint64_t v8u_t __attribute__((vector_size(8 * sizeof(uint64_t)), aligned(8), may_alias));
+
+#define LOAD8(p) (*(const v8u_t *)(p))
+#define STORE8(p, v) (*(v8u_t *)(p) = (v))
+
+/**
+ * @brief Number of 52-bit limbs for n, 0 if n is even or too large for
+ *   this engine (more than 52 * RHO52_MAX_LIMBS - RHO52_HEADROOM bits).
+ */
+int rho52_limbs_for(const mpz_t n) {
+  if (mpz_even_p(n)) {
+    return 0;
+  }
+  int limbs = (mpz_sizeinbase(n, 2) + RHO52_HEADROOM + 51) / 52;
+  return limbs > RHO52_MAX_LIMBS ? 0 : limbs;
+}
+
+/**
+ * @brief Reset a context.  Every lane must be given a modulus with
+ *   rho52_set_modulus before use; spare lanes can repeat another's.
+ */
+void rho52_ctx_init(rho52_ctx_t *ctx, int limbs) {
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->limbs = limbs;
+}
+
+// Store a into one lane as limbs 52-bit digits
+static void set_digits(int limbs, uint64_t (*r)[MONT_LANES], int lane, const mpz_t a) {
+  mpz_t t;
+  mpz_init_set(t, a);
+  for (int j = 0; j < limbs; j++) {
+    r[j][lane] = mpz_getlimbn(t, 0) & MASK52;
+    mpz_fdiv_q_2exp(t, t, 52);
+  }
+  mpz_clear(t);
+}
+
+static void get_digits(int limbs, mpz_t a, const uint64_t (*r)[MONT_LANES], int lane) {
+  mpz_set_ui(a, 0);
+  for (int j = limbs - 1; j >= 0; j--) {
+    mpz_mul_2exp(a, a, 52);
+    mpz_add_ui(a, a, r[j][lane]);
+  }
+}
+
+/**
+ * @brief Install modulus n in one lane and precompute -n^-1 and 3n.
+ */
+void rho52_set_modulus(rho52_ctx_t *ctx, int lane, const mpz_t n) {
+  mpz_t n3;
+  mpz_init(n3);
+
+  set_digits(ctx->limbs, ctx->n, lane, n);
+  mpz_mul_ui(n3, n, 3);
+  set_digits(ctx->limbs, ctx->n3, lane, n3);
+
+  // Newton iteration, each step doubles the number of correct bits
+  uint64_t n0 = ctx->n[0][lane];
+  uint64_t x = n0;
+  for (int i = 0; i < 5; i++) {
+    x *= 2 - n0 * x;
+  }
+  ctx->ninv[lane] = -x & MASK52;
+
+  mpz_clear(n3);
+}
+
+/**
+ * @brief Convert a into Montgomery form (a * R mod n) in one lane.
+ */
+void rho52_to_lane(const rho52_ctx_t *ctx, mont_vec_t r, int lane, const mpz_t a) {
+  mpz_t t, n;
+  mpz_inits(t, n, NULL);
+
+  get_digits(ctx->limbs, n, ctx->n, lane);
+  mpz_mul_2exp(t, a, 52 * ctx->limbs);
+  mpz_mod(t, t, n);
+  set_digits(ctx->limbs, r, lane, t);
+
+  mpz_clears(t, n, NULL);
+}
+
+/**
+ * @brief Read one lane back, still in Montgomery form but reduced mod n
+ *   (the kernel leaves lanes anywhere below 3n).
+ */
+void rho52_get_lane(const rho52_ctx_t *ctx, mpz_t a, const mont_vec_t r, int lane) {
+  mpz_t n;
+  mpz_init(n);
+
+  get_digits(ctx->limbs, n, ctx->n, lane);
+  get_digits(ctx->limbs, a, (const uint64_t (*)[MONT_LANES])r, lane);
+  mpz_mod(a, a, n);
+
+  mpz_clear(n);
+}
+
+// lo += (a * b) mod 2^52, hi += (a * b) >> 52, with the 52-bit operands
+// split in 26-bit halves so every partial product is one 32x32 multiply
+#define MADD26(lo, hi, a, b)                                              \
+  do {                                                                    \
+    v8_t a0_ = (a) & MASK26, a1_ = ((a) >> 26) & MASK26;                  \
+    v8_t b0_ = (b) & MASK26, b1_ = ((b) >> 26) & MASK26;                  \
+    v8_t mid_ = a1_ * b0_ + a0_ * b1_;                                    \
+    v8_t low_ = a0_ * b0_ + ((mid_ & MASK26) << 26);                      \
+    (lo) += low_ & MASK52;                                                \
+    (hi) += a1_ * b1_ + (mid_ >> 26) + (low_ >> 52);                      \
+  } while (0)
+
+#define RHO52_MADD MADD26
+
+#define RHO52_NAME(f) rho52_##f##_generic
+#define RHO52_ATTR
+#include "rho52_kernel.h"
+#undef RHO52_NAME
+#undef RHO52_ATTR
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define RHO52_NAME(f) rho52_##f##_avx2
+#define RHO52_ATTR __attribute__((target("avx2")))
+#include "rho52_kernel.h"
+#undef RHO52_NAME
+#undef RHO52_ATTR
+#undef RHO52_MADD
+
+#define MADD52(lo, hi, a, b)                                                              \
+  do {                                                                                    \
+    (lo) = (v8_t)_mm512_madd52lo_epu64((__m512i)(lo), (__m512i)(a), (__m512i)(b));        \
+    (hi) = (v8_t)_mm512_madd52hi_epu64((__m512i)(hi), (__m512i)(a), (__m512i)(b));        \
+  } while (0)
+
+#define RHO52_MADD MADD52
+#define RHO52_NAME(f) rho52_##f##_avx512ifma
+#define RHO52_ATTR __attribute__((target("avx512f,avx512ifma")))
+#include "rho52_kernel.h"
+#undef RHO52_NAME
+#undef RHO52_ATTR
+#endif
+#undef RHO52_MADD
+
+typedef void (*rho52_op_t)(const rho52_ctx_t *, mont_vec_t, mont_vec_t, const mont_vec_t, mont_vec_t, int);
+
+typedef struct {
+  const char *name;
+  const char *cpu;   // __builtin_cpu_supports feature, NULL for any CPU
+  rho52_op_t steps;
+} rho52_kernel_t;
+
+// Fastest first, rho52_select_kernel(NULL) takes the first the CPU has
+static const rho52_kernel_t rho52_kernels[] = {
+#if defined(__x86_64__) && defined(__GNUC__)
+  {"avx512ifma", "avx512ifma", rho52_steps_avx512ifma},
+  {"avx2", "avx2", rho52_steps_avx2},
+#endif
+  {"generic", NULL, rho52_steps_generic},
+};
+
+#define NUM_KERNELS (int)(sizeof(rho52_kernels) / sizeof(rho52_kernels[0]))
+
+static const rho52_kernel_t *rho52_kernel;
+
+static int kernel_supported(const rho52_kernel_t *kernel) {
+#if defined(__x86_64__) && defined(__GNUC__)
+  if (kernel->cpu != NULL) {
+    __builtin_cpu_init();
+    // __builtin_cpu_supports wants a literal
+    if (strcmp(kernel->cpu, "avx512ifma") == 0) return __builtin_cpu_supports("avx512ifma");
+    if (strcmp(kernel->cpu, "avx2") == 0) return __builtin_cpu_supports("avx2");
+    return 0;
+  }
+#endif
+  return 1;
+}
+
+/**
+ * @brief Name of built-in kernel i (0 is the fastest), NULL past the
+ *   last one.  rho52_select_kernel says whether this CPU can run it.
+ */
+const char *rho52_kernel_name(int i) {
+  if (i < 0 || i >= NUM_KERNELS) {
+    return NULL;
+  }
+  return rho52_kernels[i].name;
+}
+
+/**
+ * @brief Use the named kernel from now on, or the fastest one this CPU
+ *   supports when name is NULL.  Not thread safe, call it before any
+ *   lanes are in use.
+ *
+ * @return 1 on success, 0 if the kernel is unknown or unsupported (the
+ *   current kernel is kept).
+ */
+int rho52_select_kernel(const char *name) {
+  for (int i = 0; i < NUM_KERNELS; i++) {
+    if ((name == NULL || strcmp(name, rho52_kernels[i].name) == 0) &&
+        kernel_supported(&rho52_kernels[i])) {
+      rho52_kernel = &rho52_kernels[i];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Name of the kernel in use.
+ */
+const char *rho52_current_kernel(void) {
+  if (rho52_kernel == NULL) {
+    rho52_select_kernel(NULL);
+  }
+  return rho52_kernel->name;
+}
+
+/**
+ * @brief steps rho iterations in every lane: x = x^2 / R + c, y the
+ *   same twice, q = q * (x - y) / R.  With n < R / 16, c below n, x
+ *   and y below 3n and q below 2n, they stay that way, though not fully
+ *   reduced: each product comes out below 2n and adding c leaves x and
+ *   y below 3n.
+ */
+void rho52_steps(const rho52_ctx_t *ctx, mont_vec_t x, mont_vec_t y,
+                 const mont_vec_t c, mont_vec_t q, int steps) {
+  if (rho52_kernel == NULL) {
+    rho52_select_kernel(NULL);
+  }
+  rho52_kernel->steps(ctx, x, y, c, q, steps);
+}
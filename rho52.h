@@ -0,0 +1,45 @@
+/**
+ * @file rho52.h
+ * @brief Header for rho52.c, a Pollard Rho step kernel on radix 2^52
+ *   Montgomery numbers for 100-200 bit moduli, using AVX-512 IFMA
+ *   (vpmadd52luq/vpmadd52huq) where the CPU has it.
+ * @version 0.1
+ * @date 2021-05-29
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef _RHO52_H
+#define _RHO52_H
+
+#include <stdint.h>
+#include <gmp.h>
+
+#include "montlane.h"
+
+#define RHO52_MAX_LIMBS 4 // 52-bit limbs, so moduli up to 204 bits
+#define RHO52_HEADROOM 4  // n < R / 16 lets every product skip its final subtraction
+
+// Lanes are stored like montlane's, v[limb][lane], but with 52-bit
+// digits; only the first RHO52_MAX_LIMBS rows of a mont_vec_t are used.
+typedef struct {
+  int limbs;                                // R = 2^(52 * limbs)
+  uint64_t n[RHO52_MAX_LIMBS][MONT_LANES];  // modulus of each lane
+  uint64_t n3[RHO52_MAX_LIMBS][MONT_LANES]; // 3n, keeps x - y positive
+  uint64_t ninv[MONT_LANES];                // -n^-1 mod 2^52
+} rho52_ctx_t;
+
+int rho52_limbs_for(const mpz_t n);
+void rho52_ctx_init(rho52_ctx_t *ctx, int limbs);
+void rho52_set_modulus(rho52_ctx_t *ctx, int lane, const mpz_t n);
+void rho52_to_lane(const rho52_ctx_t *ctx, mont_vec_t r, int lane, const mpz_t a);
+void rho52_get_lane(const rho52_ctx_t *ctx, mpz_t a, const mont_vec_t r, int lane);
+
+const char *rho52_kernel_name(int i);
+int rho52_select_kernel(const char *name);
+const char *rho52_current_kernel(void);
+
+void rho52_steps(const rho52_ctx_t *ctx, mont_vec_t x, mont_vec_t y,
+                 const mont_vec_t c, mont_vec_t q, int steps);
+
+#endif
@@ -0,0 +1,132 @@
+/**
+ * @file rho52_kernel.h
+ * @brief Body of the rho52 step kernel.  rho52.c includes this once per
+ *   instruction set, with these defined:
+ *
+ *   RHO52_NAME(f)  name of f for this instruction set
+ *   RHO52_ATTR     function attributes (the target)
+ *   RHO52_MADD     RHO52_MADD(lo, hi, a, b): lo += low 52 bits and
+ *                  hi += high 52 bits of the product of the low 52 bits
+ *                  of a and b, eight lanes at a time
+ * @version 0.1
+ * @date 2021-05-29
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+// r = a * b / R mod n, with r < 2n for a * b < 12 n^2 (lazy reduction)
+RHO52_ATTR static inline __attribute__((always_inline))
+void RHO52_NAME(mul)(int k, v8_t *r, const v8_t *a, const v8_t *b, const v8_t *n, const v8_t *ninv) {
+  const v8_t mask = (v8_t){0} + MASK52;
+  v8_t t[RHO52_MAX_LIMBS + 1];
+
+  for (int j = 0; j <= k; j++) {
+    t[j] = (v8_t){0};
+  }
+
+  for (int i = 0; i < k; i++) {
+    for (int j = 0; j < k; j++) {
+      RHO52_MADD(t[j], t[j + 1], a[j], b[i]);
+    }
+
+    // m makes the low digit vanish, the high half of m * ninv is unused
+    v8_t m = {0}, unused = {0};
+    RHO52_MADD(m, unused, t[0], *ninv);
+    (void)unused;
+    for (int j = 0; j < k; j++) {
+      RHO52_MADD(t[j], t[j + 1], m, n[j]);
+    }
+
+    // digits stay unnormalized, only the carry out of t[0] moves along
+    v8_t carry = t[0] >> 52;
+    for (int j = 0; j < k; j++) {
+      t[j] = t[j + 1];
+    }
+    t[0] += carry;
+    t[k] = (v8_t){0};
+  }
+
+  for (int j = 0; j < k - 1; j++) {
+    t[j + 1] += t[j] >> 52;
+    r[j] = t[j] & mask;
+  }
+  r[k - 1] = t[k - 1];
+}
+
+// r = a + b, no reduction: a < 2n and b < n give r < 3n
+RHO52_ATTR static inline __attribute__((always_inline))
+void RHO52_NAME(add)(int k, v8_t *r, const v8_t *a, const v8_t *b) {
+  const v8_t mask = (v8_t){0} + MASK52;
+  v8_t carry = {0};
+
+  for (int j = 0; j < k; j++) {
+    v8_t s = a[j] + b[j] + carry;
+    r[j] = s & mask;
+    carry = s >> 52;
+  }
+}
+
+// r = a + 3n - b, which is positive and below 6n for a, b < 3n
+RHO52_ATTR static inline __attribute__((always_inline))
+void RHO52_NAME(sub)(int k, v8_t *r, const v8_t *a, const v8_t *b, const v8_t *n3) {
+  const v8_t mask = (v8_t){0} + MASK52;
+  v8_t carry = {0};
+
+  for (int j = 0; j < k; j++) {
+    v8_t s = a[j] + n3[j] - b[j] + carry;
+    r[j] = s & mask;
+    carry = (v8_t)((sv8_t)s >> 52);
+  }
+}
+
+// steps rho iterations on eight lanes, k limbs
+RHO52_ATTR static inline __attribute__((always_inline))
+void RHO52_NAME(block)(const rho52_ctx_t *ctx, int k, int lane0, mont_vec_t xv, mont_vec_t yv,
+                       const mont_vec_t cv, mont_vec_t qv, int steps) {
+  v8_t x[RHO52_MAX_LIMBS], y[RHO52_MAX_LIMBS], c[RHO52_MAX_LIMBS], q[RHO52_MAX_LIMBS];
+  v8_t n[RHO52_MAX_LIMBS], n3[RHO52_MAX_LIMBS], d[RHO52_MAX_LIMBS];
+  v8_t ninv = LOAD8(ctx->ninv + lane0);
+
+  for (int j = 0; j < k; j++) {
+    x[j] = LOAD8(xv[j] + lane0);
+    y[j] = LOAD8(yv[j] + lane0);
+    c[j] = LOAD8(cv[j] + lane0);
+    q[j] = LOAD8(qv[j] + lane0);
+    n[j] = LOAD8(ctx->n[j] + lane0);
+    n3[j] = LOAD8(ctx->n3[j] + lane0);
+  }
+
+  for (int s = 0; s < steps; s++) {
+    RHO52_NAME(mul)(k, x, x, x, n, &ninv);
+    RHO52_NAME(add)(k, x, x, c);
+    RHO52_NAME(mul)(k, y, y, y, n, &ninv);
+    RHO52_NAME(add)(k, y, y, c);
+    RHO52_NAME(mul)(k, y, y, y, n, &ninv);
+    RHO52_NAME(add)(k, y, y, c);
+
+    // q *= x - y, which is 0 mod p once x and y meet mod p
+    RHO52_NAME(sub)(k, d, x, y, n3);
+    RHO52_NAME(mul)(k, q, q, d, n, &ninv);
+  }
+
+  for (int j = 0; j < k; j++) {
+    STORE8(xv[j] + lane0, x[j]);
+    STORE8(yv[j] + lane0, y[j]);
+    STORE8(qv[j] + lane0, q[j]);
+  }
+}
+
+// Every lane, with the limb count fixed so the loops above unroll
+RHO52_ATTR
+static void RHO52_NAME(steps)(const rho52_ctx_t *ctx, mont_vec_t x, mont_vec_t y,
+                              const mont_vec_t c, mont_vec_t q, int steps) {
+  for (int lane0 = 0; lane0 < MONT_LANES; lane0 += 8) {
+    switch (ctx->limbs) {
+    case 1: RHO52_NAME(block)(ctx, 1, lane0, x, y, c, q, steps); break;
+    case 2: RHO52_NAME(block)(ctx, 2, lane0, x, y, c, q, steps); break;
+    case 3: RHO52_NAME(block)(ctx, 3, lane0, x, y, c, q, steps); break;
+    default: RHO52_NAME(block)(ctx, 4, lane0, x, y, c, q, steps); break;
+    }
+  }
+}
@@ -0,0 +1,444 @@
+/**
+ * @file rhobatch.c
+ * @brief Pollard Rho for a whole corpus of keys.  Every worker keeps
+ *   MONT_LANES moduli of the same limb count in a montlane (radix 2^32)
+ *   or rho52 (radix 2^52) context, each lane with its own n, x, y, c and
+ *   product accumulator, and steps all of them in lockstep.  The gcd is
+ *   only taken every rho_batch_gcd steps (tune.h), on the accumulated
+ *   product of |x - y|.  A lane whose key factors is retired and refilled from the shared queue, so the
+ *   vector stays full until the queue runs dry.
+ * @version 0.1
+ * @date 2021-05-27
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "rhobatch.h"
+#include "montlane.h"
+#include "rho52.h"
+#include "tune.h"
+#include "place.h"
+
+#define MAX_THREADS 256
+
+typedef struct {
+  size_t key;     // index into n and p
+  int wide;       // runs on rho52 rather than montlane
+  int limbs;      // rho52_limbs_for or mont_limbs_for(n[key])
+} rho_job_t;
+
+// Keys shared by all workers, handed out by engine, then smallest
+// limb count first
+typedef struct {
+  mpz_t *n;
+  mpz_t *p;
+  rho_job_t *jobs;
+  size_t count;
+  size_t next;
+  long factored;
+  uint64_t iterations;
+  int race;       // every job walks the same key, the first split ends the run
+  pthread_mutex_t lock;
+} rho_queue_t;
+
+typedef struct {
+  long key;       // index into the queue, -1 while the lane is idle
+  mpz_t rinv;     // R^-1 mod n, to replay the map when backtracking
+} rho_lane_t;
+
+typedef struct {
+  rho_queue_t *queue;
+  int id;                      // worker number, for place_pin
+  int policy;                  // placement, for place_pin
+  int wide;                    // which of the two contexts is in use
+  int limbs;
+  mont_ctx_t ctx;
+  rho52_ctx_t ctx52;
+  mont_vec_t x, y, c, q, d;
+  mont_vec_t saved_x, saved_y; // x and y at the last gcd check
+  rho_lane_t lane[MONT_LANES];
+  gmp_randstate_t state;
+  int gcd_steps;               // steps between gcd checks
+  int active;
+} rho_worker_t;
+
+static int job_cmp(const void *a, const void *b) {
+  const rho_job_t *x = a, *y = b;
+  if (x->wide != y->wide) return x->wide - y->wide;
+  if (x->limbs != y->limbs) return x->limbs - y->limbs;
+  return x->key < y->key ? -1 : x->key > y->key;
+}
+
+// Copy one lane of a into r
+static void lane_copy(const rho_worker_t *w, mont_vec_t r, const mont_vec_t a, int lane) {
+  for (int j = 0; j < w->limbs; j++) {
+    r[j][lane] = a[j][lane];
+  }
+}
+
+// The lane helpers below go to whichever engine the worker is on
+static void lane_set_modulus(rho_worker_t *w, int lane, mpz_srcptr n) {
+  if (w->wide) {
+    rho52_set_modulus(&w->ctx52, lane, n);
+  } else {
+    mont_set_modulus(&w->ctx, lane, n);
+  }
+}
+
+static int lane_has_modulus(const rho_worker_t *w, int lane) {
+  return w->wide ? w->ctx52.ninv[lane] != 0 : w->ctx.ninv[lane] != 0;
+}
+
+static void lane_to(rho_worker_t *w, mont_vec_t r, int lane, mpz_srcptr a) {
+  if (w->wide) {
+    rho52_to_lane(&w->ctx52, r, lane, a);
+  } else {
+    mont_to_lane(&w->ctx, r, lane, a);
+  }
+}
+
+static void lane_get(rho_worker_t *w, mpz_t a, const mont_vec_t r, int lane) {
+  if (w->wide) {
+    rho52_get_lane(&w->ctx52, a, r, lane);
+  } else {
+    mont_get_lane(&w->ctx, a, r, lane);
+  }
+}
+
+/**
+ * @brief Pick a fresh start x and constant c for a lane.  Also used to
+ *   restart a key whose cycle closed without splitting n.
+ */
+static void lane_seed(rho_worker_t *w, int lane) {
+  mpz_srcptr n = w->queue->n[w->lane[lane].key];
+  mpz_t r, range;
+  mpz_inits(r, range, NULL);
+
+  // x in [2, n), c in [1, n - 2), the same ranges pollardRho uses
+  mpz_sub_ui(range, n, 2);
+  mpz_urandomm(r, w->state, range);
+  mpz_add_ui(r, r, 2);
+  lane_to(w, w->x, lane, r);
+  lane_copy(w, w->y, w->x, lane);
+
+  mpz_urandomm(r, w->state, range);
+  mpz_add_ui(r, r, 1);
+  lane_to(w, w->c, lane, r);
+
+  mpz_set_ui(r, 1);
+  lane_to(w, w->q, lane, r);
+  mpz_clears(r, range, NULL);
+}
+
+/**
+ * @brief Take the next key of the context's engine and limb count for
+ *   an idle lane.
+ *
+ * @return 1 if the lane got a key.
+ */
+static int lane_refill(rho_worker_t *w, int lane) {
+  rho_queue_t *queue = w->queue;
+
+  pthread_mutex_lock(&queue->lock);
+  if (queue->next == queue->count || queue->jobs[queue->next].wide != w->wide ||
+      queue->jobs[queue->next].limbs != w->limbs) {
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+  }
+  size_t key = queue->jobs[queue->next++].key;
+  pthread_mutex_unlock(&queue->lock);
+
+  mpz_srcptr n = queue->n[key];
+  w->lane[lane].key = key;
+  lane_set_modulus(w, lane, n);
+
+  mpz_set_ui(w->lane[lane].rinv, 1);
+  mpz_mul_2exp(w->lane[lane].rinv, w->lane[lane].rinv, (w->wide ? 52 : 32) * w->limbs);
+  mpz_invert(w->lane[lane].rinv, w->lane[lane].rinv, n);
+
+  lane_seed(w, lane);
+  w->active++;
+  return 1;
+}
+
+/**
+ * @brief Fill every idle lane.  Once all lanes are idle the context is
+ *   rebuilt for the engine and limb count of the next key in the queue.
+ */
+static void refill(rho_worker_t *w) {
+  rho_queue_t *queue = w->queue;
+
+  if (w->active == 0) {
+    pthread_mutex_lock(&queue->lock);
+    rho_job_t next = queue->next < queue->count ? queue->jobs[queue->next] : (rho_job_t){0};
+    pthread_mutex_unlock(&queue->lock);
+    if (next.limbs == 0) {
+      return;
+    }
+    w->wide = next.wide;
+    w->limbs = next.limbs;
+    if (w->wide) {
+      rho52_ctx_init(&w->ctx52, w->limbs);
+    } else {
+      mont_ctx_init(&w->ctx, w->limbs);
+    }
+  }
+
+  int first = -1;
+  for (int lane = 0; lane < MONT_LANES; lane++) {
+    if (w->lane[lane].key < 0) {
+      lane_refill(w, lane);
+    }
+    if (first < 0 && w->lane[lane].key >= 0) {
+      first = lane;
+    }
+  }
+
+  // after a rebuild idle lanes still need a valid modulus, borrow one
+  if (first >= 0) {
+    for (int lane = 0; lane < MONT_LANES; lane++) {
+      if (w->lane[lane].key < 0 && !lane_has_modulus(w, lane)) {
+        lane_set_modulus(w, lane, queue->n[w->lane[first].key]);
+      }
+    }
+  }
+}
+
+/**
+ * @brief The accumulator hit 0 mod n, so x and y met mod p and mod q in
+ *   the same block of steps.  Replay the block one step at a time from
+ *   the saved x and y, taking the gcd at every step.
+ *
+ * @return 1 with the factor in p, 0 if the lane needs a new c.
+ */
+static int lane_backtrack(rho_worker_t *w, int lane, mpz_t p) {
+  mpz_srcptr n = w->queue->n[w->lane[lane].key];
+  mpz_t x, y, c, t;
+  mpz_inits(x, y, c, t, NULL);
+  int found = 0;
+
+  lane_get(w, x, w->saved_x, lane);
+  lane_get(w, y, w->saved_y, lane);
+  lane_get(w, c, w->c, lane);
+
+  // f(v) = v^2 / R + c, the map both engines compute
+  for (int s = 0; s < w->gcd_steps && !found; s++) {
+    mpz_mul(x, x, x);
+    mpz_mul(x, x, w->lane[lane].rinv);
+    mpz_add(x, x, c);
+    mpz_mod(x, x, n);
+    for (int twice = 0; twice < 2; twice++) {
+      mpz_mul(y, y, y);
+      mpz_mul(y, y, w->lane[lane].rinv);
+      mpz_add(y, y, c);
+      mpz_mod(y, y, n);
+    }
+
+    mpz_sub(t, x, y);
+    mpz_gcd(p, t, n);
+    if (mpz_cmp_ui(p, 1) != 0) {
+      found = mpz_cmp(p, n) != 0;
+      break;
+    }
+  }
+
+  mpz_clears(x, y, c, t, NULL);
+  return found;
+}
+
+/**
+ * @brief Take the gcd of every active lane's accumulator with its n,
+ *   retiring the lanes whose key split.
+ */
+static void check_lanes(rho_worker_t *w) {
+  rho_queue_t *queue = w->queue;
+  mpz_t g;
+  mpz_init(g);
+
+  for (int lane = 0; lane < MONT_LANES; lane++) {
+    long key = w->lane[lane].key;
+    if (key < 0) {
+      continue;
+    }
+
+    lane_get(w, g, w->q, lane);
+    mpz_gcd(g, g, queue->n[key]);
+    if (mpz_cmp_ui(g, 1) == 0) {
+      continue;
+    }
+
+    if (mpz_cmp(g, queue->n[key]) == 0 && !lane_backtrack(w, lane, g)) {
+      lane_seed(w, lane);
+      continue;
+    }
+
+    mpz_set(queue->p[key], g);
+    __atomic_add_fetch(&queue->factored, 1, __ATOMIC_RELAXED);
+    w->lane[lane].key = -1;
+    w->active--;
+
+    if (queue->race) {
+      // the other walks were on the same n, retire them all
+      for (int l = 0; l < MONT_LANES; l++) {
+        w->lane[l].key = -1;
+      }
+      w->active = 0;
+      break;
+    }
+  }
+
+  mpz_clear(g);
+}
+
+/**
+ * @brief gcd_steps rho steps on every lane of a montlane context.
+ */
+static void mont_steps(rho_worker_t *w) {
+  for (int s = 0; s < w->gcd_steps; s++) {
+    mont_mul(&w->ctx, w->x, w->x, w->x);
+    mont_add(&w->ctx, w->x, w->x, w->c);
+    mont_mul(&w->ctx, w->y, w->y, w->y);
+    mont_add(&w->ctx, w->y, w->y, w->c);
+    mont_mul(&w->ctx, w->y, w->y, w->y);
+    mont_add(&w->ctx, w->y, w->y, w->c);
+
+    // q *= x - y, which is 0 mod p once x and y meet mod p
+    mont_sub(&w->ctx, w->d, w->x, w->y);
+    mont_mul(&w->ctx, w->q, w->q, w->d);
+  }
+}
+
+/**
+ * @brief Method each worker follows: keep the lanes full and step them
+ *   until the queue is empty and every lane has retired.
+ */
+static void *rho_worker(void *input) {
+  rho_worker_t *w = (rho_worker_t *)input;
+  uint64_t steps = 0;
+
+  place_pin(w->policy, w->id);
+  for (;;) {
+    refill(w);
+    if (w->active == 0) {
+      break;
+    }
+
+    memcpy(w->saved_x, w->x, w->limbs * sizeof(w->x[0]));
+    memcpy(w->saved_y, w->y, w->limbs * sizeof(w->y[0]));
+    if (w->wide) {
+      rho52_steps(&w->ctx52, w->x, w->y, w->c, w->q, w->gcd_steps);
+    } else {
+      mont_steps(w);
+    }
+    steps += (uint64_t)w->gcd_steps * w->active;
+
+    check_lanes(w);
+  }
+
+  __atomic_add_fetch(&w->queue->iterations, steps, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+/**
+ * @brief rho_batch, or with race every lane of one worker on its own
+ *   walk of the single key n[0].
+ */
+static long rho_run(mpz_t *n, mpz_t *p, size_t count, int race, int threads, uint64_t *iterations) {
+  rho_queue_t queue = {0};
+  pthread_t thread_ids[MAX_THREADS];
+  int copies = race ? MONT_LANES : 1;
+
+  if (threads < 1) threads = 1;
+  if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+  queue.n = n;
+  queue.p = p;
+  queue.race = race;
+  queue.jobs = malloc(count * copies * sizeof(rho_job_t));
+
+  // settle the keys rho can't work on: prime, even or too large
+  for (size_t i = 0; i < count; i++) {
+    int wide = tune_use_rho52(&tune_profile) && rho52_limbs_for(n[i]);
+    int limbs = wide ? rho52_limbs_for(n[i]) : mont_limbs_for(n[i]);
+    if (mpz_cmp_ui(n[i], 3) <= 0 || mpz_probab_prime_p(n[i], 25)) {
+      mpz_set_ui(p[i], 0);
+    } else if (mpz_even_p(n[i])) {
+      mpz_set_ui(p[i], 2);
+      queue.factored++;
+    } else if (limbs == 0) {
+      mpz_set_ui(p[i], 0);
+    } else {
+      for (int copy = 0; copy < copies; copy++) {
+        queue.jobs[queue.count].key = i;
+        queue.jobs[queue.count].wide = wide;
+        queue.jobs[queue.count].limbs = limbs;
+        queue.count++;
+      }
+    }
+  }
+  qsort(queue.jobs, queue.count, sizeof(rho_job_t), job_cmp);
+  pthread_mutex_init(&queue.lock, NULL);
+
+  // each worker's lanes live on the node it is pinned to
+  int policy = place_policy(tune_profile.placement);
+  rho_worker_t *workers[MAX_THREADS];
+  for (int t = 0; t < threads; t++) {
+    workers[t] = place_alloc(sizeof(rho_worker_t), place_node(policy, t));
+    workers[t]->queue = &queue;
+    workers[t]->id = t;
+    workers[t]->policy = policy;
+    workers[t]->gcd_steps = tune_profile.rho_batch_gcd;
+    gmp_randinit_mt(workers[t]->state);
+    gmp_randseed_ui(workers[t]->state, t + 1);
+    for (int lane = 0; lane < MONT_LANES; lane++) {
+      workers[t]->lane[lane].key = -1;
+      mpz_init(workers[t]->lane[lane].rinv);
+    }
+    pthread_create(&thread_ids[t], NULL, rho_worker, workers[t]);
+  }
+
+  for (int t = 0; t < threads; t++) {
+    pthread_join(thread_ids[t], NULL);
+    gmp_randclear(workers[t]->state);
+    for (int lane = 0; lane < MONT_LANES; lane++) {
+      mpz_clear(workers[t]->lane[lane].rinv);
+    }
+    place_free(workers[t], sizeof(rho_worker_t));
+  }
+
+  if (iterations != NULL) {
+    *iterations = queue.iterations;
+  }
+  pthread_mutex_destroy(&queue.lock);
+  free(queue.jobs);
+  return queue.factored;
+}
+
+/**
+ * @brief Factor many moduli at once.
+ *
+ * @param n moduli to factor.
+ * @param p initialized mpz_t for each modulus, set to a nontrivial
+ *   factor, or 0 when n is prime or too large for the lane engine.
+ * @param count number of moduli.
+ * @param threads number of workers, each with its own set of lanes.
+ * @param iterations if not NULL, set to the total rho steps taken.
+ * @return number of moduli factored.
+ */
+long rho_batch(mpz_t *n, mpz_t *p, size_t count, int threads, uint64_t *iterations) {
+  return rho_run(n, p, count, 0, threads, iterations);
+}
+
+/**
+ * @brief Factor one modulus on every lane of one worker, each lane a
+ *   walk with its own start and constant, until the first one splits it.
+ *
+ * @return 1 with the factor in *p, 0 as rho_batch.
+ */
+long rho_batch_race(mpz_t *n, mpz_t *p, uint64_t *iterations) {
+  return rho_run(n, p, 1, 1, 1, iterations);
+}
@@ -0,0 +1,20 @@
+/**
+ * @file rhobatch.h
+ * @brief Header for rhobatch.c, Pollard Rho over many moduli at once,
+ *   one modulus per Montgomery lane.
+ * @version 0.1
+ * @date 2021-05-27
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef _RHOBATCH_H
+#define _RHOBATCH_H
+
+#include <stdint.h>
+#include <gmp.h>
+
+long rho_batch(mpz_t *n, mpz_t *p, size_t count, int threads, uint64_t *iterations);
+long rho_batch_race(mpz_t *n, mpz_t *p, uint64_t *iterations);
+
+#endif
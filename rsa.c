@@ -6,6 +6,8 @@
 #include <assert.h>
 
 #include "rsa.h"
+#include "montlane.h"
+#include "sieve.h"
 
 #define IO_BYTE_ORDER 0
 #define IO_ENDIANNESS 0
@@ -86,12 +88,6 @@ void rsa_testkeys(rsa_keys_t *keys)
 */
 void rsa_genkeys(unsigned int num_bits, rsa_keys_t *keys)
 {
-	mpz_inits(keys->p, keys->q, keys->n, 
-	keys->d, keys->e, NULL);
-		
-	mpz_t lambda;
-	mpz_inits(lambda, NULL);
-
 	// initialize the GMP random number generator 
 	// using the Mersenne Twister algorithm
 	gmp_randstate_t state;
@@ -104,17 +100,60 @@ void rsa_genkeys(unsigned int num_bits, rsa_keys_t *keys)
 	rsa_init_from_devrandom(state);
 #endif
 
-	// pick a random number for p, make sure its prime
-	mpz_urandomb(keys->p, state, num_bits / 2);
-	mpz_nextprime(keys->p, keys->p);
-	
-	// pick a random number of q, make sure its prime
-	int num_p_bits = mpz_sizeinbase(keys->p, 2);
-	mpz_urandomb(keys->q, state, num_bits - num_p_bits);
-	mpz_nextprime(keys->q, keys->q);
-	
-	// compute n = p * q
-	mpz_mul(keys->n, keys->p, keys->q);
+	rsa_genkeys_state(num_bits, keys, state);
+	gmp_randclear(state);
+}
+
+// Same as rsa_genkeys, but draws from the caller's random state, so
+// bulk generators can seed once per thread (or deterministically).
+void rsa_genkeys_state(unsigned int num_bits, rsa_keys_t *keys, 
+	gmp_randstate_t state)
+{
+	rsa_genkeys_gap(num_bits, keys, state, 0);
+}
+
+// A weak generator for audits: with gap_bits > 0, q is the next prime
+// after p plus a random number of gap_bits bits, so Fermat's method
+// factors n quickly.  With 0 it is rsa_genkeys_state.  gap_bits is
+// held below num_bits / 2, so q stays the size of p.
+void rsa_genkeys_gap(unsigned int num_bits, rsa_keys_t *keys, 
+	gmp_randstate_t state, unsigned int gap_bits)
+{
+	mpz_inits(keys->p, keys->q, keys->n, 
+	keys->d, keys->e, NULL);
+
+	if (gap_bits >= num_bits / 2) {
+		gap_bits = num_bits / 2 - 1;
+	}
+		
+	mpz_t lambda;
+	mpz_inits(lambda, NULL);
+
+	// Draw p and q again if they are equal or if e has no inverse
+	// mod lambda, compute_keys would assert on those.  A gap can also
+	// carry n past num_bits, which the block sizes are computed for.
+	do {
+		// pick a random number for p, make sure its prime
+		mpz_urandomb(keys->p, state, num_bits / 2);
+		sieve_next_prime(keys->p, keys->p);
+	
+		// pick a random number of q, make sure its prime
+		if (gap_bits > 0) {
+			mpz_urandomb(keys->q, state, gap_bits);
+			mpz_add(keys->q, keys->q, keys->p);
+		} else {
+			int num_p_bits = mpz_sizeinbase(keys->p, 2);
+			mpz_urandomb(keys->q, state, num_bits - num_p_bits);
+		}
+		sieve_next_prime(keys->q, keys->q);
+
+		// compute n = p * q
+		mpz_mul(keys->n, keys->p, keys->q);
+		compute_totient(lambda, keys->p, keys->q);
+	} while (mpz_cmp(keys->p, keys->q) == 0 || 
+		mpz_sizeinbase(keys->n, 2) > num_bits ||
+		mpz_cmp_ui(lambda, DEFAULT_E) <= 0 ||
+		mpz_gcd_ui(NULL, lambda, DEFAULT_E) != 1);
 
 	// determine the block sizes based on these numbers
 	// we can only encode a chunk whose value is smaller than n,
@@ -126,8 +165,7 @@ void rsa_genkeys(unsigned int num_bits, rsa_keys_t *keys)
 	//assert( mpz_sizeinbase(keys->n, 256) > keys->enc_block_size);
 	//assert( mpz_sizeinbase(keys->n, 256) <= keys->dec_block_size);
 	
-	// step 3 - compute Carmichael's totient
-	compute_totient(lambda, keys->p, keys->q);
+	// step 3 - Carmichael's totient is already in lambda
 
 	// step 4 & 5 - compute d & e
 	compute_keys(keys, lambda);
@@ -323,12 +361,123 @@ size_t rsa_decrypt(char *message, char *decrypted, int message_bytes,
 }
 
 
+/* *********************** Batch (lane-parallel) functions ***************** */
+
+// Largest moduli the lanes beat mpz_powm on (bench-batch).  A full-size
+// d has GMP's 64-bit digits level with the lanes from two 32-bit digits.
+#define LANES_E_MAX_BITS 256
+#define LANES_D_MAX_BITS 32
+
+// Run nblocks blocks of the input through x^exp mod n, MONT_LANES blocks
+// at a time.  Every block of a message shares n and the exponent, so the
+// lanes all follow the same exponentiation schedule.
+static void rsa_crypt_lanes(const mpz_t exp, const mpz_t n, 
+	int in_block_size, int out_block_size, int nblocks, 
+	const char *in, char *out)
+{
+	mont_ctx_t *ctx = malloc(sizeof(mont_ctx_t));
+	mont_vec_t *x = calloc(1, sizeof(mont_vec_t));
+	mont_vec_t *y = calloc(1, sizeof(mont_vec_t));
+
+	mont_ctx_init(ctx, mont_limbs_for(n));
+	for (int lane = 0; lane < MONT_LANES; lane++) {
+		mont_set_modulus(ctx, lane, n);
+	}
+
+	for (int first = 0; first < nblocks; first += MONT_LANES) {
+		int lanes = nblocks - first;
+		if (lanes > MONT_LANES) lanes = MONT_LANES;
+
+		// blocks go in and out in the same byte order as BLOCK_TO_MPZ
+		// and MPZ_TO_BLOCK use
+		for (int lane = 0; lane < lanes; lane++) {
+			mont_set_bytes(ctx, *x, lane, in + (first + lane) * in_block_size, 
+				in_block_size);
+		}
+
+		mont_enter(ctx, *x, *x);
+		mont_powm(ctx, *y, *x, exp);
+		mont_redc(ctx, *y, *y);
+
+		for (int lane = 0; lane < lanes; lane++) {
+			mont_get_bytes(ctx, out + (first + lane) * out_block_size, 
+				out_block_size, *y, lane);
+		}
+	}
+
+	free(y);
+	free(x);
+	free(ctx);
+}
+
+// Same as rsa_encrypt, but the blocks are encrypted MONT_LANES at a time.
+// Keys over LANES_E_MAX_BITS go through rsa_encrypt.
+size_t rsa_encrypt_batch(char *message, char *encrypted, int message_bytes, 
+	rsa_keys_t *keys)
+{
+	int in_block_size = keys->enc_block_size;
+	int out_block_size = keys->dec_block_size;
+
+	if (in_block_size == 0 || mpz_sizeinbase(keys->n, 2) > LANES_E_MAX_BITS ||
+		mont_limbs_for(keys->n) == 0) {
+		return rsa_encrypt(message, encrypted, message_bytes, keys);
+	}
+
+	// zero pad the last block, like rsa_encrypt does
+	int nblocks = (message_bytes + in_block_size - 1) / in_block_size;
+	char *padded = calloc(nblocks, in_block_size);
+	memcpy(padded, message, message_bytes);
+
+	rsa_crypt_lanes(keys->e, keys->n, in_block_size, out_block_size, 
+		nblocks, padded, encrypted);
+
+	free(padded);
+	return (size_t)nblocks * out_block_size;
+}
+
+// Same as rsa_decrypt, but the blocks are decrypted MONT_LANES at a time.
+// Keys over LANES_D_MAX_BITS go through rsa_decrypt.
+size_t rsa_decrypt_batch(char *message, char *decrypted, int message_bytes, 
+	rsa_keys_t *keys)
+{
+	int in_block_size = keys->dec_block_size;
+	int out_block_size = keys->enc_block_size;
+
+	if (out_block_size == 0 || mpz_sizeinbase(keys->n, 2) > LANES_D_MAX_BITS ||
+		mont_limbs_for(keys->n) == 0) {
+		return rsa_decrypt(message, decrypted, message_bytes, keys);
+	}
+
+	int nblocks = (message_bytes + in_block_size - 1) / in_block_size;
+	char *padded = calloc(nblocks, in_block_size);
+	memcpy(padded, message, message_bytes);
+
+	rsa_crypt_lanes(keys->d, keys->n, in_block_size, out_block_size, 
+		nblocks, padded, decrypted);
+
+	free(padded);
+	return (size_t)nblocks * out_block_size;
+}
+
+
 /* *********************** Key I/O functions ******************************* */
 
 // Write the private keys to the given file name 
 void rsa_write_private_keys(rsa_keys_t *keys, const char *fname)
 {
 	FILE *fp = fopen(fname,"w+");
+	if (fp == NULL) {
+		perror("Error - could not write private key");
+		exit(-1);
+	}
+
+	rsa_fwrite_private_keys(keys, fp);
+	fclose(fp);
+}
+
+// Write the private keys to an open file, in the key file format
+void rsa_fwrite_private_keys(rsa_keys_t *keys, FILE *fp)
+{
 	fprintf(fp,"KEY FILE\n");
 	fprintf(fp,"%d %d %d\n", keys->num_bits,
 		keys->enc_block_size, keys->dec_block_size);
@@ -338,8 +487,6 @@ void rsa_write_private_keys(rsa_keys_t *keys, const char *fname)
 	mpz_out_str(fp,16,keys->n);fprintf(fp,"\n");
 	mpz_out_str(fp,16,keys->d);fprintf(fp,"\n");
 	mpz_out_str(fp,16,keys->e);fprintf(fp,"\n");
-	
-	fclose(fp);
 }
 
 
@@ -352,23 +499,38 @@ void rsa_write_public_keys(rsa_keys_t *keys, const char *fname)
 		exit(-1);
 	}
 	
+	rsa_fwrite_public_keys(keys, fp);
+	fclose(fp);
+}
+
+// Write the public keys to an open file, in the key file format
+void rsa_fwrite_public_keys(rsa_keys_t *keys, FILE *fp)
+{
 	fprintf(fp,"KEY FILE\n");
 	fprintf(fp,"%d %d %d\n", keys->num_bits,
 		keys->enc_block_size, keys->dec_block_size);
 	
 	mpz_out_str(fp,16,keys->n); fprintf(fp,"\n");
 	mpz_out_str(fp,16,keys->e); fprintf(fp,"\n");
-	
-	fclose(fp);
 }
 
 // Read the private keys from the given file name
 void rsa_read_private_keys(rsa_keys_t *keys, const char *fname)
 {
 	FILE *fp = fopen(fname,"r");
+	rsa_fread_private_keys(keys, fp);
+	fclose(fp);
+}
+
+// Read the private keys from an open file, in the key file format.
+// Returns 0 if the file is already at its end.
+int rsa_fread_private_keys(rsa_keys_t *keys, FILE *fp)
+{
 	char inp[1024];
 	
-	fgets(inp, 1023, fp);
+	if (fgets(inp, 1023, fp) == NULL) {
+		return 0;
+	}
 	fscanf(fp,"%d %d %d", &keys->num_bits,
 		&keys->enc_block_size, &keys->dec_block_size);
 	
@@ -381,7 +543,7 @@ void rsa_read_private_keys(rsa_keys_t *keys, const char *fname)
 	mpz_inp_str(keys->d,fp, 16);
 	mpz_inp_str(keys->e,fp, 16);
 	
-	fclose(fp);
+	return 1;
 }
 
 // Read the public keys from the given file
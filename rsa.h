@@ -35,6 +35,7 @@ typedef struct
 	rsa_keys_t *keys;
 	int *found;
 	mpz_t p;
+	unsigned long seed; // pollardRho random seed, 0 for the fixed default
 	//pthread_mutex_t lock;
 } rsa_decrypt_t;
 
@@ -48,13 +49,20 @@ typedef struct
 #define DEFAULT_E 101
 
 void rsa_genkeys(unsigned int num_bits, rsa_keys_t *keys);
+void rsa_genkeys_state(unsigned int num_bits, rsa_keys_t *keys, gmp_randstate_t state);
+void rsa_genkeys_gap(unsigned int num_bits, rsa_keys_t *keys, gmp_randstate_t state, unsigned int gap_bits);
 size_t rsa_encrypt(char *message, char *encrypted, int message_bytes, rsa_keys_t *keys);
 size_t rsa_decrypt(char *message, char *decrypted, int message_bytes, rsa_keys_t *keys);
+size_t rsa_encrypt_batch(char *message, char *encrypted, int message_bytes, rsa_keys_t *keys);
+size_t rsa_decrypt_batch(char *message, char *decrypted, int message_bytes, rsa_keys_t *keys);
 void rsa_testkeys(rsa_keys_t *keys);
 
 void rsa_read_public_keys(rsa_keys_t *keys, const char *fname);
 void rsa_read_private_keys(rsa_keys_t *keys, const char *fname);
+int rsa_fread_private_keys(rsa_keys_t *keys, FILE *fp);
 void rsa_write_public_keys(rsa_keys_t *keys, const char *fname);
 void rsa_write_private_keys(rsa_keys_t *keys, const char *fname);
+void rsa_fwrite_public_keys(rsa_keys_t *keys, FILE *fp);
+void rsa_fwrite_private_keys(rsa_keys_t *keys, FILE *fp);
 
 #endif
\ No newline at end of file
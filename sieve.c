@@ -0,0 +1,265 @@
+/**
+ * @file sieve.c
+ * @brief Find the next prime after a number by sieving an interval of
+ *   odd candidates with a small-prime bitmap and only running the
+ *   Miller-Rabin rounds on the survivors.  Gives the same prime as
+ *   mpz_nextprime.
+ * @version 0.1
+ * @date 2021-05-22
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sieve.h"
+
+static unsigned int small_primes[SIEVE_PRIME_LIMIT / 2];
+static int num_small_primes;
+
+// Small primes are grouped so that each group's product fits in an
+// unsigned long; one mpz_fdiv_ui per group then gives every residue.
+static unsigned long group_product[SIEVE_PRIME_LIMIT / 2];
+static int group_start[SIEVE_PRIME_LIMIT / 2 + 1];
+static int num_groups;
+
+static pthread_once_t small_primes_once = PTHREAD_ONCE_INIT;
+
+// Odd primes below SIEVE_PRIME_LIMIT and their groups, filled in once
+static void init_small_primes(void) {
+  static char composite[SIEVE_PRIME_LIMIT];
+
+  for (unsigned int i = 3; i < SIEVE_PRIME_LIMIT; i += 2) {
+    if (composite[i]) {
+      continue;
+    }
+    small_primes[num_small_primes++] = i;
+    for (unsigned int j = i * i; j < SIEVE_PRIME_LIMIT; j += 2 * i) {
+      composite[j] = 1;
+    }
+  }
+
+  unsigned long product = 1;
+  for (int k = 0; k < num_small_primes; k++) {
+    if (product > (unsigned long)-1 / small_primes[k]) {
+      group_product[num_groups++] = product;
+      product = 1;
+    }
+    if (product == 1) {
+      group_start[num_groups] = k;
+    }
+    product *= small_primes[k];
+  }
+  group_product[num_groups++] = product;
+  group_start[num_groups] = num_small_primes;
+}
+
+// 64-bit Montgomery arithmetic for the word-sized Miller-Rabin test,
+// valid for odd n < 2^63
+typedef struct {
+  uint64_t n;
+  uint64_t ninv; // -n^-1 mod 2^64
+  uint64_t one;  // 2^64 mod n
+} mont64_t;
+
+static void mont64_init(mont64_t *m, uint64_t n) {
+  uint64_t x = n;
+  for (int i = 0; i < 5; i++) {
+    x *= 2 - n * x;
+  }
+  m->n = n;
+  m->ninv = -x;
+  m->one = (uint64_t)(((unsigned __int128)1 << 64) % n);
+}
+
+static uint64_t mont64_mul(const mont64_t *m, uint64_t a, uint64_t b) {
+  unsigned __int128 t = (unsigned __int128)a * b;
+  uint64_t u = (uint64_t)t * m->ninv;
+  // n < 2^63, so t + u n < 2^128 and the result is below 2n
+  uint64_t r = (t + (unsigned __int128)u * m->n) >> 64;
+  return r >= m->n ? r - m->n : r;
+}
+
+// Strong probable prime test to one base, n odd
+static int sprp_u64(const mont64_t *m, uint64_t base, uint64_t d, int s) {
+  uint64_t n = m->n;
+  uint64_t minus_one = n - m->one;
+  uint64_t b = (uint64_t)(((unsigned __int128)(base % n) << 64) % n);
+  uint64_t x = m->one;
+
+  if (b == 0) {
+    return 1;
+  }
+  for (uint64_t e = d; e; e >>= 1) {
+    if (e & 1) {
+      x = mont64_mul(m, x, b);
+    }
+    b = mont64_mul(m, b, b);
+  }
+  if (x == m->one || x == minus_one) {
+    return 1;
+  }
+  for (int r = 1; r < s; r++) {
+    x = mont64_mul(m, x, x);
+    if (x == minus_one) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Deterministic Miller-Rabin: the first k prime bases are exact below
+// the matching bound (Jaeschke, Feitsma/Galway), all twelve below 2^64.
+static int is_prime_u64(uint64_t n) {
+  static const uint64_t bases[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+  static const uint64_t bounds[] = {2047ULL, 1373653ULL, 25326001ULL,
+    3215031751ULL, 2152302898747ULL, 3474749660383ULL, 341550071728321ULL,
+    341550071728321ULL, 3825123056546413051ULL, 3825123056546413051ULL,
+    3825123056546413051ULL, 0};
+  mont64_t m;
+  uint64_t d = n - 1;
+  int s = 0;
+
+  while ((d & 1) == 0) {
+    d >>= 1;
+    s++;
+  }
+  mont64_init(&m, n);
+
+  for (int k = 0; k < 12; k++) {
+    if (!sprp_u64(&m, bases[k], d, s)) {
+      return 0;
+    }
+    if (bounds[k] && n < bounds[k]) {
+      return 1;
+    }
+  }
+  return 1;
+}
+
+// Strike the multiples of the first num_primes small primes from the
+// interval of odd numbers base, base + 2, ..., base + 2(len - 1).
+static void strike_u64(uint64_t *bitmap, uint64_t base, unsigned int len, int num_primes) {
+  for (int k = 0; k < num_primes; k++) {
+    unsigned int q = small_primes[k];
+    unsigned int r = base % q;
+
+    unsigned int i = ((q - r) % q) * ((q + 1) / 2) % q;
+    for (; i < len; i += q) {
+      bitmap[i / 64] |= (uint64_t)1 << (i % 64);
+    }
+  }
+}
+
+// sieve_next_prime for starts that fit in a machine word
+static uint64_t next_prime_u64(uint64_t start, int bits) {
+  uint64_t bitmap[SIEVE_WORDS];
+  unsigned int len = (bits / 16 + 1) * 64;
+  int num_primes = bits * 4;
+  uint64_t base = (start + 1) | 1;
+
+  if (num_primes > num_small_primes) {
+    num_primes = num_small_primes;
+  }
+
+  for (;; base += 2 * len) {
+    memset(bitmap, 0, len / 8);
+    strike_u64(bitmap, base, len, num_primes);
+
+    for (unsigned int i = 0; i < len; i++) {
+      if (!(bitmap[i / 64] & ((uint64_t)1 << (i % 64))) && is_prime_u64(base + 2 * i)) {
+        return base + 2 * i;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Set p to the smallest prime greater than start.
+ *
+ * @param p mpz_t to store the prime in.
+ * @param start mpz_t number to search up from.
+ */
+void sieve_next_prime(mpz_t p, const mpz_t start) {
+  pthread_once(&small_primes_once, init_small_primes);
+
+  // Below the sieve limit the sieve would strike the primes themselves
+  if (mpz_cmp_ui(start, SIEVE_PRIME_LIMIT) < 0) {
+    mpz_nextprime(p, start);
+    return;
+  }
+
+  // Size the interval and the prime bound to the expected prime gap,
+  // ~ln(start), so small keys don't pay for a sieve they won't use.
+  int bits = mpz_sizeinbase(start, 2);
+
+  if (bits < 63) {
+    mpz_set_ui(p, next_prime_u64(mpz_get_ui(start), bits));
+    return;
+  }
+
+  int words = bits / 16 + 1;
+  if (words > SIEVE_WORDS) {
+    words = SIEVE_WORDS;
+  }
+  int groups = bits + 8;
+  if (groups > num_groups) {
+    groups = num_groups;
+  }
+
+  uint64_t bitmap[SIEVE_WORDS];
+  unsigned int len = words * 64; // odd candidates per interval
+
+  mpz_t base, candidate, two, fermat;
+  mpz_inits(base, candidate, two, fermat, NULL);
+  mpz_set_ui(two, 2);
+
+  // bit i of the bitmap stands for base + 2i
+  mpz_add_ui(base, start, 1);
+  if (mpz_even_p(base)) {
+    mpz_add_ui(base, base, 1);
+  }
+
+  for (;;) {
+    memset(bitmap, 0, words * sizeof(uint64_t));
+
+    for (int g = 0; g < groups; g++) {
+      unsigned long residue = mpz_fdiv_ui(base, group_product[g]);
+
+      for (int k = group_start[g]; k < group_start[g + 1]; k++) {
+        unsigned int q = small_primes[k];
+        unsigned int r = residue % q;
+
+        // first i with base + 2i = 0 (mod q)
+        unsigned int i = ((q - r) % q) * ((q + 1) / 2) % q;
+        for (; i < len; i += q) {
+          bitmap[i / 64] |= (uint64_t)1 << (i % 64);
+        }
+      }
+    }
+
+    for (unsigned int i = 0; i < len; i++) {
+      if (bitmap[i / 64] & ((uint64_t)1 << (i % 64))) {
+        continue;
+      }
+      mpz_add_ui(candidate, base, 2 * i);
+
+      // a base 2 Fermat test throws out almost every composite survivor
+      // before the full Miller-Rabin rounds
+      mpz_sub_ui(fermat, candidate, 1);
+      mpz_powm(fermat, two, fermat, candidate);
+      if (mpz_cmp_ui(fermat, 1) != 0) {
+        continue;
+      }
+      if (mpz_probab_prime_p(candidate, SIEVE_MR_ROUNDS)) {
+        mpz_set(p, candidate);
+        mpz_clears(base, candidate, two, fermat, NULL);
+        return;
+      }
+    }
+
+    mpz_add_ui(base, base, 2 * len);
+  }
+}
@@ -0,0 +1,21 @@
+/**
+ * @file sieve.h
+ * @brief Header for sieve.c, prime search over candidate intervals.
+ * @version 0.1
+ * @date 2021-05-22
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef _SIEVE_H
+#define _SIEVE_H
+
+#include <gmp.h>
+
+#define SIEVE_PRIME_LIMIT 8192 // Small primes used to strike candidates
+#define SIEVE_WORDS 64         // Bitmap words per interval (64 odd numbers each)
+#define SIEVE_MR_ROUNDS 25     // Rounds for mpz_probab_prime_p on survivors
+
+void sieve_next_prime(mpz_t p, const mpz_t start);
+
+#endif
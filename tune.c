@@ -0,0 +1,190 @@
+/**
+ * @file tune.c
+ * @brief Tuning profile: the knobs that used to be compile-time guesses
+ *   (thread counts, gcd batch length, Montgomery kernels, engine
+ *   crossovers and the cost model constants).  The profile is a small
+ *   text file, one "name value" per line, so it can be read and edited
+ *   by hand.  Unknown names are ignored and missing ones keep their
+ *   defaults, so older profiles keep loading as engines are added.
+ * @version 0.1
+ * @date 2021-05-28
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "tune.h"
+#include "montlane.h"
+#include "rho52.h"
+#include "cfrac.h"
+#include "place.h"
+
+#define TUNE_HEADER "TUNE PROFILE"
+
+#define TUNE_BUILTIN {                                 \
+  .threads = 1,                                       \
+  .batch_threads = 1,                                 \
+  .rho_batch_gcd = RHO_BATCH_GCD,                     \
+  .kernel = "",                                       \
+  .rho_kernel = "",                                   \
+  .rho_batch_min_bits = 0,                            \
+  .cfrac_min_bits = CFRAC_MIN_BITS,                   \
+  .fermat_budget = FERMAT_BUDGET,                     \
+  .placement = "none",                                \
+  .codebook_ns_per_candidate = CODEBOOK_NS_PER_CANDIDATE, \
+  .rho_ns_per_iteration = RHO_NS_PER_ITERATION,       \
+  .batch_ns_per_iteration = RHO_NS_PER_ITERATION,     \
+  .cfrac_ns_per_unit = CFRAC_NS_PER_UNIT,             \
+}
+
+static const tune_profile_t tune_builtin = TUNE_BUILTIN;
+
+// The profile in use, the built-in one until tune_apply
+tune_profile_t tune_profile = TUNE_BUILTIN;
+
+/**
+ * @brief The built-in profile, what every program uses without tune.txt.
+ */
+void tune_defaults(tune_profile_t *profile) {
+  *profile = tune_builtin;
+}
+
+/**
+ * @brief Read a profile over the defaults.
+ *
+ * @return 1 if the file was read, 0 if there is none (profile holds the
+ *   defaults).
+ */
+int tune_load(const char *fname, tune_profile_t *profile) {
+  char line[256], name[64], value[64];
+
+  tune_defaults(profile);
+  FILE *fp = fopen(fname, "r");
+  if (fp == NULL) {
+    return 0;
+  }
+
+  if (fgets(line, sizeof(line), fp) == NULL || strncmp(line, TUNE_HEADER, strlen(TUNE_HEADER)) != 0) {
+    printf("Error - %s is not a tuning profile\n", fname);
+    exit(-1);
+  }
+
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    value[0] = 0;
+    if (line[0] == '#' || sscanf(line, "%63s %63s", name, value) < 1) {
+      continue;
+    }
+
+    if (strcmp(name, "threads") == 0) profile->threads = atoi(value);
+    else if (strcmp(name, "batch_threads") == 0) profile->batch_threads = atoi(value);
+    else if (strcmp(name, "rho_batch_gcd") == 0) profile->rho_batch_gcd = atoi(value);
+    else if (strcmp(name, "kernel") == 0) snprintf(profile->kernel, sizeof(profile->kernel), "%s", value);
+    else if (strcmp(name, "rho_kernel") == 0) snprintf(profile->rho_kernel, sizeof(profile->rho_kernel), "%s", value);
+    else if (strcmp(name, "rho_batch_min_bits") == 0) profile->rho_batch_min_bits = atoi(value);
+    else if (strcmp(name, "cfrac_min_bits") == 0) profile->cfrac_min_bits = atoi(value);
+    else if (strcmp(name, "fermat_budget") == 0) profile->fermat_budget = atol(value);
+    else if (strcmp(name, "placement") == 0) snprintf(profile->placement, sizeof(profile->placement), "%s", value);
+    else if (strcmp(name, "cfrac_ns_per_unit") == 0) profile->cfrac_ns_per_unit = atof(value);
+    else if (strcmp(name, "codebook_ns_per_candidate") == 0) profile->codebook_ns_per_candidate = atof(value);
+    else if (strcmp(name, "rho_ns_per_iteration") == 0) profile->rho_ns_per_iteration = atof(value);
+    else if (strcmp(name, "batch_ns_per_iteration") == 0) profile->batch_ns_per_iteration = atof(value);
+  }
+  fclose(fp);
+
+  if (profile->threads < 1) profile->threads = 1;
+  if (profile->threads > TUNE_MAX_THREADS) profile->threads = TUNE_MAX_THREADS;
+  if (profile->batch_threads < 1) profile->batch_threads = 1;
+  if (profile->rho_batch_gcd < 1) profile->rho_batch_gcd = RHO_BATCH_GCD;
+  if (profile->fermat_budget < 0) profile->fermat_budget = 0;
+  if (place_policy(profile->placement) < 0) {
+    printf("Error - unknown placement %s in %s\n", profile->placement, fname);
+    exit(-1);
+  }
+  return 1;
+}
+
+void tune_save(const char *fname, const tune_profile_t *profile) {
+  FILE *fp = fopen(fname, "w+");
+  if (fp == NULL) {
+    perror("could not write tuning profile");
+    exit(-1);
+  }
+
+  fprintf(fp, "%s\n", TUNE_HEADER);
+  fprintf(fp, "threads %d\n", profile->threads);
+  fprintf(fp, "batch_threads %d\n", profile->batch_threads);
+  fprintf(fp, "rho_batch_gcd %d\n", profile->rho_batch_gcd);
+  fprintf(fp, "kernel %s\n", profile->kernel);
+  fprintf(fp, "rho_kernel %s\n", profile->rho_kernel);
+  fprintf(fp, "rho_batch_min_bits %d\n", profile->rho_batch_min_bits);
+  fprintf(fp, "cfrac_min_bits %d\n", profile->cfrac_min_bits);
+  fprintf(fp, "fermat_budget %ld\n", profile->fermat_budget);
+  fprintf(fp, "placement %s\n", profile->placement);
+  fprintf(fp, "codebook_ns_per_candidate %.1f\n", profile->codebook_ns_per_candidate);
+  fprintf(fp, "rho_ns_per_iteration %.1f\n", profile->rho_ns_per_iteration);
+  fprintf(fp, "batch_ns_per_iteration %.1f\n", profile->batch_ns_per_iteration);
+  fprintf(fp, "cfrac_ns_per_unit %.3f\n", profile->cfrac_ns_per_unit);
+  fclose(fp);
+}
+
+/**
+ * @brief Make a profile the one in use: the cost model and rho_batch read
+ *   tune_profile, the kernels are selected here.
+ */
+void tune_apply(const tune_profile_t *profile) {
+  if (profile != &tune_profile) {
+    tune_profile = *profile;
+  }
+  if (profile->kernel[0] == 0 || !mont_select_kernel(profile->kernel)) {
+    mont_select_kernel(NULL);
+  }
+  if (profile->rho_kernel[0] == 0 || !rho52_select_kernel(profile->rho_kernel)) {
+    rho52_select_kernel(NULL);
+  }
+}
+
+/**
+ * @brief Expected Pollard Rho iterations for a balanced bits-bit modulus,
+ *   sqrt(pi p / 2) with p near sqrt(n).
+ */
+double tune_rho_iterations(int bits) {
+  return sqrt(M_PI / 2) * pow(2, bits / 4.0);
+}
+
+/**
+ * @brief Cost model unit for a bits-bit n, L(n) = exp(sqrt(ln n ln ln n)).
+ *   With the factor base and early abort tuned, cfrac time grows about
+ *   as L(n) from 100 to 160 bits.
+ */
+double tune_cfrac_units(int bits) {
+  double ln = bits * log(2);
+  return exp(sqrt(ln * log(ln)));
+}
+
+/**
+ * @brief Whether a single key of this size goes to rho_batch rather than
+ *   pollardRho threads.
+ */
+int tune_use_rho_batch(const tune_profile_t *profile, int bits) {
+  return profile->rho_batch_min_bits > 0 && bits >= profile->rho_batch_min_bits;
+}
+
+/**
+ * @brief Whether rho_batch runs the keys that fit on the radix 2^52
+ *   kernel rather than on montlane.
+ */
+int tune_use_rho52(const tune_profile_t *profile) {
+  return strcmp(profile->rho_kernel, "montlane") != 0;
+}
+
+/**
+ * @brief Whether a single key of this size goes to cfrac rather than to
+ *   either rho engine.
+ */
+int tune_use_cfrac(const tune_profile_t *profile, int bits) {
+  return profile->cfrac_min_bits > 0 && bits >= profile->cfrac_min_bits && bits <= CFRAC_MAX_BITS;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file tune.h
+ * @brief Header for tune.c, the per-machine tuning profile written by
+ *   autotune and loaded by find-key.
+ * @version 0.1
+ * @date 2021-05-28
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef _TUNE_H
+#define _TUNE_H
+
+#define TUNE_PROFILE "tune.txt"  // default profile file
+#define TUNE_MAX_THREADS 64
+
+// Built-in profile, what every program uses without tune.txt
+#define RHO_BATCH_GCD 128             // rho_batch lane steps between gcd checks
+#define CFRAC_MIN_BITS 64             // key size find-key hands to cfrac
+#define FERMAT_BUDGET (1UL << 22)     // candidates the per key Fermat pass tries
+#define CODEBOOK_NS_PER_CANDIDATE 120 // one lane-parallel trial encryption
+#define RHO_NS_PER_ITERATION 600      // one pollardRho loop iteration
+#define CFRAC_NS_PER_UNIT 1.0         // cfrac, per tune_cfrac_units
+
+typedef struct {
+  int threads;                   // pollardRho threads racing on one key
+  int batch_threads;             // rho_batch workers for a corpus
+  int rho_batch_gcd;             // rho_batch steps between gcd checks
+  char kernel[16];               // montlane kernel, "" for the fastest
+  char rho_kernel[16];           // rho52 kernel, "" for the fastest, "montlane" for none
+  int rho_batch_min_bits;        // single keys this size and up use rho_batch, 0 never
+  int cfrac_min_bits;            // single keys this size and up use cfrac, 0 never
+  long fermat_budget;            // Fermat candidates tried on every key first, 0 none
+  char placement[16];            // worker placement: "none", "cores" or "threads"
+  double codebook_ns_per_candidate;
+  double rho_ns_per_iteration;   // pollardRho
+  double batch_ns_per_iteration; // rho_batch with a single key
+  double cfrac_ns_per_unit;      // cfrac, per tune_cfrac_units
+} tune_profile_t;
+
+extern tune_profile_t tune_profile;
+
+void tune_defaults(tune_profile_t *profile);
+int tune_load(const char *fname, tune_profile_t *profile);
+void tune_save(const char *fname, const tune_profile_t *profile);
+void tune_apply(const tune_profile_t *profile);
+
+double tune_rho_iterations(int bits);
+double tune_cfrac_units(int bits);
+int tune_use_rho_batch(const tune_profile_t *profile, int bits);
+int tune_use_rho52(const tune_profile_t *profile);
+int tune_use_cfrac(const tune_profile_t *profile, int bits);
+
+#endif